@@ -0,0 +1,213 @@
+#include "BatchRunner.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Context.h"
+
+using namespace std;
+
+// Constructor
+BatchRunner::BatchRunner(LemVM& vm, int stackSize): vm(vm), stackSize(stackSize) {}
+
+/**
+ * Gets whether a file is a LemASM program, going by its extension.
+ * 
+ * @param fileName The name of the file.
+ * @return True if the file ends in .lasm, .lemasm or .lbc, false otherwise.
+ */
+bool BatchRunner::isProgramFile(string fileName) {
+    string extension = filesystem::path(fileName).extension().string();
+    return extension == ".lasm" || extension == ".lemasm" || extension == ".lbc";
+}
+
+/**
+ * Adds a job that runs the given file.
+ * Jobs of the same file share one program, files are compared by their canonical path.
+ * 
+ * @param fileName The name of the file to run.
+ */
+void BatchRunner::addJob(string fileName) {
+    error_code error;
+    string key = filesystem::weakly_canonical(fileName, error).string();
+    if (error) key = fileName;
+
+    auto entry = programIndexes.find(key);
+    if (entry == programIndexes.end()) {
+        entry = programIndexes.insert({key, (int) programs.size()}).first;
+        programs.push_back(make_unique<BatchProgram>());
+    }
+
+    BatchJob job;
+    job.fileName = fileName;
+    job.programIndex = entry->second;
+    jobs.push_back(job);
+}
+
+/**
+ * Adds a job for every program listed in a manifest.
+ * A manifest lists one program per line, relative paths are relative to the directory of the manifest.
+ * Empty lines and lines that start with "//" are skipped, like in LemASM itself.
+ * 
+ * @param fileName The name of the manifest.
+ * @param errorHandler The error handler to report errors to.
+ * @return 0 if the manifest was read successfully, 1 otherwise.
+ */
+int BatchRunner::addManifest(string fileName, ErrorHandler& errorHandler) {
+    ifstream file(fileName);
+    if (!file.is_open()) {
+        errorHandler.handleErrorNoLine("Could not open file: " + fileName);
+        return 1;
+    }
+
+    filesystem::path directory = filesystem::path(fileName).parent_path();
+    string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos || line.compare(first, 2, "//") == 0) continue;
+        string entry = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+
+        if (!isProgramFile(entry)) {
+            errorHandler.handleErrorWithLine("Invalid file format.\nAcceptable formats are: \".lasm\", \".lemasm\" or \".lbc\".", lineNumber, line);
+            return 1;
+        }
+        filesystem::path path(entry);
+        addJob(path.is_absolute() ? entry : (directory / path).string());
+    }
+    return 0;
+}
+
+/**
+ * Adds a job for every program in a directory, in the order of their names.
+ * Subdirectories and files that are not programs are skipped.
+ * 
+ * @param directoryName The name of the directory.
+ * @param errorHandler The error handler to report errors to.
+ * @return 0 if the directory was read successfully, 1 otherwise.
+ */
+int BatchRunner::addDirectory(string directoryName, ErrorHandler& errorHandler) {
+    error_code error;
+    vector<string> fileNames;
+    for (auto const& entry : filesystem::directory_iterator(directoryName, error)) {
+        if (entry.is_regular_file() && isProgramFile(entry.path().string())) fileNames.push_back(entry.path().string());
+    }
+    if (error) {
+        errorHandler.handleErrorNoLine("Could not open directory: " + directoryName);
+        return 1;
+    }
+
+    sort(fileNames.begin(), fileNames.end());
+    for (const string& fileName : fileNames) addJob(fileName);
+    return 0;
+}
+
+/**
+ * Gets the next job for a worker, from the back of its own queue or else from the front of another queue.
+ * 
+ * @param worker The index of the worker.
+ * @param job Is set to the index of the job.
+ * @return True if a job was found, false if every queue is empty.
+ */
+bool BatchRunner::nextJob(int worker, int& job) {
+    {
+        lock_guard<mutex> lock(*queueLocks[worker]);
+        if (!queues[worker].empty()) {
+            job = queues[worker].back();
+            queues[worker].pop_back();
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < queues.size(); offset++) {
+        int victim = (worker + offset) % queues.size();
+        lock_guard<mutex> lock(*queueLocks[victim]);
+        if (!queues[victim].empty()) {
+            job = queues[victim].front();
+            queues[victim].pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Runs jobs until every queue is empty.
+ * No jobs are added once the batch has started, so an empty set of queues means the worker is done.
+ * 
+ * @param worker The index of the worker.
+ */
+void BatchRunner::work(int worker) {
+    int job;
+    while (nextJob(worker, job)) runJob(jobs[job]);
+}
+
+/**
+ * Runs a single job in its own context, loading its program first if no other job has.
+ * The errors of the job are kept with it rather than written to the error stream, where they would interleave with those of the other workers.
+ * 
+ * @param job The job to run.
+ */
+void BatchRunner::runJob(BatchJob& job) {
+    BatchProgram& shared = *programs[job.programIndex];
+    call_once(shared.loaded, [&]() {
+        ErrorHandler::capture(&shared.errors);
+        shared.failed = vm.load(job.fileName, shared.program) != 0;
+        ErrorHandler::capture(nullptr);
+    });
+    if (shared.failed) {
+        job.failed = true;
+        job.result = 1;
+        job.errors = shared.errors;
+        return;
+    }
+
+    Context context(stackSize);
+    context.getOutput().capture();
+    ErrorHandler::capture(&job.errors);
+    job.result = vm.run(shared.program, context);
+    ErrorHandler::capture(nullptr);
+    job.failed = context.hasFailed();
+    job.output = context.getOutput().getCaptured();
+}
+
+/**
+ * Runs every job of the batch and waits for them to finish.
+ * The jobs are dealt out to the workers in contiguous blocks, so neighbouring jobs of the same file tend to run on the same thread.
+ * 
+ * @param threadCount The number of worker threads, there are never more workers than jobs.
+ */
+void BatchRunner::run(int threadCount) {
+    int workerCount = max(1, min(threadCount, (int) jobs.size()));
+    queues.assign(workerCount, deque<int>());
+    queueLocks.clear();
+    for (int i = 0; i < workerCount; i++) queueLocks.push_back(make_unique<mutex>());
+    for (size_t i = 0; i < jobs.size(); i++) queues[i * workerCount / jobs.size()].push_back(i);
+
+    vector<thread> workers;
+    for (int i = 1; i < workerCount; i++) workers.emplace_back(&BatchRunner::work, this, i);
+    work(0);
+    for (thread& worker : workers) worker.join();
+}
+
+/**
+ * Gets the jobs of the batch, in the order they were added.
+ * 
+ * @return The jobs.
+ */
+const vector<BatchJob>& BatchRunner::getJobs() const {
+    return jobs;
+}
+
+/**
+ * Gets the number of distinct programs the jobs run.
+ * 
+ * @return The number of programs.
+ */
+int BatchRunner::getProgramCount() const {
+    return programs.size();
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ErrorHandler.h"
+#include "LemVM.h"
+#include "Program.h"
+
+using namespace std;
+
+// One program run of a batch, the results are filled in once it has run.
+struct BatchJob {
+    string fileName;      // The file of the program, as given in the manifest.
+    int programIndex;     // The index of the shared program the job runs.
+    int result = 0;       // What RET returned, or 1 if the program failed.
+    bool failed = false;  // Did the program fail to load or stop with a runtime error.
+    string output;        // Everything the program printed.
+    string errors;        // The errors the program was loaded or stopped with.
+};
+
+// A program that one or more jobs run, it is loaded by the first job that needs it and then shared read-only.
+struct BatchProgram {
+    Program program;
+    once_flag loaded;
+    bool failed = false;
+    string errors; // The errors the program was loaded with, every job that runs it reports them.
+};
+
+/**
+ * Runs many programs at once on a work-stealing thread pool, for the --batch flag.
+ * 
+ * Every worker thread has its own queue of jobs. A worker takes jobs from the back of its own queue,
+ * and once that is empty it steals from the front of the queues of the other workers, so a worker that
+ * drew a few slow programs does not hold up the batch.
+ * 
+ * Every job runs in its own Context, so jobs never share a stack or an output buffer.
+ * A file that appears many times in a batch is only loaded once, all of its jobs run the same Program.
+ */
+class BatchRunner {
+private:
+    LemVM& vm;
+    int stackSize;
+    vector<BatchJob> jobs;
+    vector<unique_ptr<BatchProgram>> programs;
+    map<string, int> programIndexes;
+    vector<deque<int>> queues;
+    vector<unique_ptr<mutex>> queueLocks;
+
+    void addJob(string fileName);
+    bool nextJob(int worker, int& job);
+    void work(int worker);
+    void runJob(BatchJob& job);
+
+public:
+    BatchRunner(LemVM& vm, int stackSize);
+
+    int addManifest(string fileName, ErrorHandler& errorHandler);
+    int addDirectory(string directoryName, ErrorHandler& errorHandler);
+    void run(int threadCount);
+    const vector<BatchJob>& getJobs() const;
+    int getProgramCount() const;
+
+    static bool isProgramFile(string fileName);
+};
@@ -0,0 +1,354 @@
+#include "BulkKernels.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#ifdef LEMASM_SIMD_SUPPORTED
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// The reductions of SUM, PRD, MIN and MAX.
+enum class Reduction {
+    SUM,
+    PRODUCT,
+    MINIMUM,
+    MAXIMUM
+};
+
+/**
+ * Gets the value a reduction starts from, which does not change the result.
+ * 
+ * @return The identity of the reduction.
+ */
+template <Reduction Kind, typename Value>
+static inline Value identity() {
+    if constexpr (Kind == Reduction::SUM) return 0;
+    else if constexpr (Kind == Reduction::PRODUCT) return 1;
+    else if constexpr (Kind == Reduction::MINIMUM) return numeric_limits<Value>::max();
+    else return numeric_limits<Value>::min();
+}
+
+/**
+ * Combines two values, sums and products wrap around like they do in the execution loop.
+ * 
+ * @param a The first value.
+ * @param b The second value.
+ * @return The combined value.
+ */
+template <Reduction Kind, typename Value>
+static inline Value combine(Value a, Value b) {
+    typedef make_unsigned_t<Value> Unsigned;
+    if constexpr (Kind == Reduction::SUM) return (Value) ((Unsigned) a + (Unsigned) b);
+    else if constexpr (Kind == Reduction::PRODUCT) return (Value) ((Unsigned) a * (Unsigned) b);
+    else if constexpr (Kind == Reduction::MINIMUM) return min(a, b);
+    else return max(a, b);
+}
+
+/**
+ * Reduces values one at a time.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @param result The value to start from.
+ * @return The reduced value.
+ */
+template <Reduction Kind, typename Value>
+static Value reduceScalar(const Value* values, int count, Value result) {
+    for (int i = 0; i < count; i++) result = combine<Kind>(result, values[i]);
+    return result;
+}
+
+#ifdef LEMASM_SIMD_SUPPORTED
+// Compiles a function for AVX2, it must only be called once hasSimdKernels() returned true.
+#define LEMASM_AVX2 __attribute__((target("avx2")))
+
+/**
+ * Fills every lane of a vector with the same value.
+ * 
+ * @param value The value.
+ * @return The vector.
+ */
+template <typename Value>
+LEMASM_AVX2 static inline __m256i broadcast(Value value) {
+    if constexpr (sizeof(Value) == 4) return _mm256_set1_epi32(value);
+    else return _mm256_set1_epi64x(value);
+}
+
+/**
+ * Combines two vectors lane by lane, see combine().
+ * AVX2 has no 64-bit multiply, so 64-bit products are never reduced with vectors.
+ * 
+ * @param a The first vector.
+ * @param b The second vector.
+ * @return The combined vector.
+ */
+template <Reduction Kind, typename Value>
+LEMASM_AVX2 static inline __m256i combineVectors(__m256i a, __m256i b) {
+    if constexpr (sizeof(Value) == 4) {
+        if constexpr (Kind == Reduction::SUM) return _mm256_add_epi32(a, b);
+        else if constexpr (Kind == Reduction::PRODUCT) return _mm256_mullo_epi32(a, b);
+        else if constexpr (Kind == Reduction::MINIMUM) return _mm256_min_epi32(a, b);
+        else return _mm256_max_epi32(a, b);
+    } else {
+        static_assert(Kind != Reduction::PRODUCT, "AVX2 has no 64-bit multiply.");
+        if constexpr (Kind == Reduction::SUM) return _mm256_add_epi64(a, b);
+        else if constexpr (Kind == Reduction::MINIMUM) return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+        else return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(b, a));
+    }
+}
+
+/**
+ * Reduces a whole vector of values at a time, then the lanes and the values that are left over one at a time.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @return The reduced value.
+ */
+template <Reduction Kind, typename Value>
+LEMASM_AVX2 static Value reduceAvx2(const Value* values, int count) {
+    const int lanes = sizeof(__m256i) / sizeof(Value);
+    __m256i accumulator = broadcast(identity<Kind, Value>());
+    int i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        accumulator = combineVectors<Kind, Value>(accumulator, _mm256_loadu_si256((const __m256i*) (values + i)));
+    }
+    alignas(32) Value lane[lanes];
+    _mm256_store_si256((__m256i*) lane, accumulator);
+    return reduceScalar<Kind>(values + i, count - i, reduceScalar<Kind>(lane, lanes, identity<Kind, Value>()));
+}
+
+/**
+ * Fills values with the same value, a whole vector at a time.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @param value The value to fill with.
+ */
+template <typename Value>
+LEMASM_AVX2 static void fillAvx2(Value* values, int count, Value value) {
+    const int lanes = sizeof(__m256i) / sizeof(Value);
+    __m256i vector = broadcast(value);
+    int i = 0;
+    for (; i + lanes <= count; i += lanes) _mm256_storeu_si256((__m256i*) (values + i), vector);
+    fill(values + i, values + count, value);
+}
+
+/**
+ * Writes start, start + 1, start + 2 and so on, a whole vector at a time.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @param start The first value to write.
+ */
+template <typename Value>
+LEMASM_AVX2 static void sequenceAvx2(Value* values, int count, Value start) {
+    typedef make_unsigned_t<Value> Unsigned;
+    const int lanes = sizeof(__m256i) / sizeof(Value);
+    __m256i vector, step = broadcast((Value) lanes);
+    if constexpr (sizeof(Value) == 4) vector = _mm256_add_epi32(broadcast(start), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    else vector = _mm256_add_epi64(broadcast(start), _mm256_setr_epi64x(0, 1, 2, 3));
+    int i = 0;
+    for (; i + lanes <= count; i += lanes) {
+        _mm256_storeu_si256((__m256i*) (values + i), vector);
+        if constexpr (sizeof(Value) == 4) vector = _mm256_add_epi32(vector, step);
+        else vector = _mm256_add_epi64(vector, step);
+    }
+    for (; i < count; i++) values[i] = (Value) ((Unsigned) start + (Unsigned) i);
+}
+
+/**
+ * Reverses the order of the lanes of a vector.
+ * 
+ * @param vector The vector.
+ * @return The reversed vector.
+ */
+template <typename Value>
+LEMASM_AVX2 static inline __m256i reverseLanes(__m256i vector) {
+    if constexpr (sizeof(Value) == 4) return _mm256_permutevar8x32_epi32(vector, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    else return _mm256_permute4x64_epi64(vector, 0x1B);
+}
+
+/**
+ * Reverses values in place, swapping a whole vector from each end at a time.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ */
+template <typename Value>
+LEMASM_AVX2 static void reverseAvx2(Value* values, int count) {
+    const int lanes = sizeof(__m256i) / sizeof(Value);
+    Value* left = values;
+    Value* right = values + count;
+    while (right - left >= 2 * lanes) {
+        __m256i low = _mm256_loadu_si256((const __m256i*) left);
+        __m256i high = _mm256_loadu_si256((const __m256i*) (right - lanes));
+        _mm256_storeu_si256((__m256i*) left, reverseLanes<Value>(high));
+        _mm256_storeu_si256((__m256i*) (right - lanes), reverseLanes<Value>(low));
+        left += lanes;
+        right -= lanes;
+    }
+    reverse(left, right);
+}
+#endif
+
+/**
+ * Gets whether the CPU supports the AVX2 kernels, it is only checked the first time.
+ * 
+ * @return True if the AVX2 kernels are used, false if the plain loops are.
+ */
+bool hasSimdKernels() {
+#ifdef LEMASM_SIMD_SUPPORTED
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    return supported;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Reduces values with the AVX2 kernel if the CPU supports it, or one at a time otherwise.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @return The reduced value.
+ */
+template <Reduction Kind, typename Value>
+static Value reduce(const Value* values, int count) {
+#ifdef LEMASM_SIMD_SUPPORTED
+    if constexpr (Kind != Reduction::PRODUCT || sizeof(Value) == 4) {
+        if (hasSimdKernels()) return reduceAvx2<Kind>(values, count);
+    }
+#endif
+    return reduceScalar<Kind>(values, count, identity<Kind, Value>());
+}
+
+/**
+ * Adds up values, for SUM.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @return The sum, wrapped around to the width of the values.
+ */
+int sumValues(const int* values, int count) {
+    return reduce<Reduction::SUM>(values, count);
+}
+
+// Adds up 64-bit values, see the 32-bit overload.
+int64_t sumValues(const int64_t* values, int count) {
+    return reduce<Reduction::SUM>(values, count);
+}
+
+/**
+ * Multiplies values, for PRD.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @return The product, wrapped around to the width of the values.
+ */
+int productValues(const int* values, int count) {
+    return reduce<Reduction::PRODUCT>(values, count);
+}
+
+// Multiplies 64-bit values, see the 32-bit overload.
+int64_t productValues(const int64_t* values, int count) {
+    return reduce<Reduction::PRODUCT>(values, count);
+}
+
+/**
+ * Finds the smallest of values, for MIN.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @return The smallest value.
+ */
+int minimumValue(const int* values, int count) {
+    return reduce<Reduction::MINIMUM>(values, count);
+}
+
+// Finds the smallest of 64-bit values, see the 32-bit overload.
+int64_t minimumValue(const int64_t* values, int count) {
+    return reduce<Reduction::MINIMUM>(values, count);
+}
+
+/**
+ * Finds the largest of values, for MAX.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @return The largest value.
+ */
+int maximumValue(const int* values, int count) {
+    return reduce<Reduction::MAXIMUM>(values, count);
+}
+
+// Finds the largest of 64-bit values, see the 32-bit overload.
+int64_t maximumValue(const int64_t* values, int count) {
+    return reduce<Reduction::MAXIMUM>(values, count);
+}
+
+/**
+ * Fills values with the same value, for FIL.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @param value The value to fill with.
+ */
+void fillValues(int* values, int count, int value) {
+#ifdef LEMASM_SIMD_SUPPORTED
+    if (hasSimdKernels()) return fillAvx2(values, count, value);
+#endif
+    fill(values, values + count, value);
+}
+
+// Fills 64-bit values with the same value, see the 32-bit overload.
+void fillValues(int64_t* values, int count, int64_t value) {
+#ifdef LEMASM_SIMD_SUPPORTED
+    if (hasSimdKernels()) return fillAvx2(values, count, value);
+#endif
+    fill(values, values + count, value);
+}
+
+/**
+ * Writes start, start + 1, start + 2 and so on, for SEQ, the values wrap around past the largest value.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ * @param start The first value to write.
+ */
+void sequenceValues(int* values, int count, int start) {
+#ifdef LEMASM_SIMD_SUPPORTED
+    if (hasSimdKernels()) return sequenceAvx2(values, count, start);
+#endif
+    for (int i = 0; i < count; i++) values[i] = (int) ((unsigned) start + (unsigned) i);
+}
+
+// Writes a sequence of 64-bit values, see the 32-bit overload.
+void sequenceValues(int64_t* values, int count, int64_t start) {
+#ifdef LEMASM_SIMD_SUPPORTED
+    if (hasSimdKernels()) return sequenceAvx2(values, count, start);
+#endif
+    for (int i = 0; i < count; i++) values[i] = (int64_t) ((uint64_t) start + (uint64_t) i);
+}
+
+/**
+ * Reverses the order of values in place, for REV.
+ * 
+ * @param values The first value.
+ * @param count The number of values.
+ */
+void reverseValues(int* values, int count) {
+#ifdef LEMASM_SIMD_SUPPORTED
+    if (hasSimdKernels()) return reverseAvx2(values, count);
+#endif
+    reverse(values, values + count);
+}
+
+// Reverses the order of 64-bit values, see the 32-bit overload.
+void reverseValues(int64_t* values, int count) {
+#ifdef LEMASM_SIMD_SUPPORTED
+    if (hasSimdKernels()) return reverseAvx2(values, count);
+#endif
+    reverse(values, values + count);
+}
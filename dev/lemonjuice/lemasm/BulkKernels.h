@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+
+using namespace std;
+
+// The AVX2 kernels use the target attribute and the CPU detection builtins of GCC and Clang, so they are only available on x86-64.
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LEMASM_SIMD_SUPPORTED
+#endif
+
+/**
+ * The kernels behind the bulk opcodes (SUM, PRD, MIN, MAX, FIL, SEQ and REV), which work on many values of the stack at once.
+ * 
+ * Every kernel works on a contiguous run of values, the bottom one first, and wraps around on overflow like the execution loop does.
+ * If the CPU supports AVX2, which is checked once at runtime, the kernels process 8 (32-bit) or 4 (64-bit) values per instruction,
+ * otherwise they fall back to plain loops.
+ * There is one overload for each value width, see Program::getValueBits().
+ */
+int sumValues(const int* values, int count);
+int64_t sumValues(const int64_t* values, int count);
+int productValues(const int* values, int count);
+int64_t productValues(const int64_t* values, int count);
+int minimumValue(const int* values, int count);
+int64_t minimumValue(const int64_t* values, int count);
+int maximumValue(const int* values, int count);
+int64_t maximumValue(const int64_t* values, int count);
+void fillValues(int* values, int count, int value);
+void fillValues(int64_t* values, int count, int64_t value);
+void sequenceValues(int* values, int count, int start);
+void sequenceValues(int64_t* values, int count, int64_t start);
+void reverseValues(int* values, int count);
+void reverseValues(int64_t* values, int count);
+bool hasSimdKernels();
@@ -0,0 +1,276 @@
+#include "BytecodeFile.h"
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static_assert(sizeof(Instruction) == 16, "Instructions are stored in bytecode files as they are laid out in memory.");
+static_assert(sizeof(BytecodeHeader) == 48, "The bytecode header layout must not change without a new BYTECODE_VERSION.");
+
+// Constructor
+BytecodeFile::BytecodeFile()
+    : mapping(nullptr), mappingSize(0), header(nullptr), instructions(nullptr), constants(nullptr), strings(nullptr), lines(nullptr), labels(nullptr),
+      data(nullptr) {}
+
+// Destructor
+BytecodeFile::~BytecodeFile() {
+    if (mapping != nullptr) munmap(mapping, mappingSize);
+}
+
+/**
+ * Computes the 64-bit FNV-1a hash of some bytes.
+ * 
+ * @param bytes The bytes to hash.
+ * @param size The number of bytes.
+ * @param hash The hash of the bytes before these ones, so that a hash can be computed in parts.
+ * @return The hash.
+ */
+uint64_t BytecodeFile::checksum(const char* bytes, size_t size, uint64_t hash) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char) bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Computes the checksum of a bytecode file, which covers every field of the header after the checksum itself,
+ * so that a changed count is caught like a changed instruction.
+ * 
+ * @param header The header of the file.
+ * @param payload Everything after the header.
+ * @param size The size of the payload.
+ * @return The checksum.
+ */
+uint64_t BytecodeFile::fileChecksum(const BytecodeHeader& header, const char* payload, size_t size) {
+    const size_t fieldsOffset = offsetof(BytecodeHeader, valueBits);
+    uint64_t hash = checksum((const char*) &header + fieldsOffset, sizeof(BytecodeHeader) - fieldsOffset);
+    return checksum(payload, size, hash);
+}
+
+/**
+ * Writes a compiled program to a bytecode file.
+ * 
+ * @param fileName The name of the file to write.
+ * @param instructions The instructions, their line indexes must refer to the lines.
+ * @param constants The literals that do not fit in an operand, PSHW operands are indexes into them.
+ * @param strings The strings of the data section, CPR operands are indexes into them.
+ * @param lines The lines the instructions were compiled from.
+ * @param labels The labels of the code section, their targets must be indexes of the instructions.
+ * @param data The string data the strings, lines and labels refer to.
+ * @param valueBits The width of the values of the program, 32 or 64.
+ * @return 0 if the file was written successfully, 1 otherwise.
+ */
+int BytecodeFile::write(string fileName, const vector<Instruction>& instructions, const vector<int64_t>& constants, const vector<StringRef>& strings,
+                        const vector<LineRef>& lines, const vector<LabelRef>& labels, const string& data, int valueBits) {
+    string payload;
+    payload.append((const char*) instructions.data(), instructions.size() * sizeof(Instruction));
+    payload.append((const char*) constants.data(), constants.size() * sizeof(int64_t));
+    payload.append((const char*) strings.data(), strings.size() * sizeof(StringRef));
+    payload.append((const char*) lines.data(), lines.size() * sizeof(LineRef));
+    payload.append((const char*) labels.data(), labels.size() * sizeof(LabelRef));
+    payload.append(data);
+
+    BytecodeHeader header = {{'L', 'B', 'C', '\0'}, BYTECODE_VERSION, 0,
+                             (uint32_t) valueBits, (uint32_t) instructions.size(),
+                             (uint32_t) constants.size(), (uint32_t) strings.size(),
+                             (uint32_t) lines.size(), (uint32_t) labels.size(), (uint64_t) data.size()};
+    header.checksum = fileChecksum(header, payload.data(), payload.size());
+
+    ofstream file(fileName, ios::binary);
+    if (!file.is_open()) return 1;
+    file.write((const char*) &header, sizeof(header));
+    file.write(payload.data(), payload.size());
+    return file.good() ? 0 : 1;
+}
+
+/**
+ * Loads a bytecode file by memory mapping it.
+ * Nothing is parsed or copied, the instructions and strings are used straight from the mapped pages.
+ * 
+ * The file is rejected if it was written by another version of the format, if its checksum does not match,
+ * or if any instruction refers to something outside of the file.
+ * 
+ * @param fileName The name of the file to load.
+ * @param errorHandler The error handler to report errors with.
+ * @param reportErrors Should errors be reported, the parse cache loads its entries without reporting them.
+ * @return 0 if the file was loaded successfully, 1 otherwise.
+ */
+int BytecodeFile::load(string fileName, ErrorHandler& errorHandler, bool reportErrors) {
+    // Reports an error and unmaps the file, so that a failed load leaves nothing behind.
+    auto fail = [&](string errorMessage) {
+        if (reportErrors) errorHandler.handleErrorNoLine(errorMessage);
+        if (mapping != nullptr) munmap(mapping, mappingSize);
+        mapping = nullptr;
+        header = nullptr;
+        return 1;
+    };
+
+    int descriptor = open(fileName.c_str(), O_RDONLY);
+    if (descriptor == -1) {
+        return fail("Could not open file: " + fileName);
+    }
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || status.st_size < (off_t) sizeof(BytecodeHeader)) {
+        close(descriptor);
+        return fail("Invalid bytecode file: " + fileName);
+    }
+
+    mappingSize = status.st_size;
+    mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        return fail("Could not map file: " + fileName);
+    }
+
+    const char* bytes = (const char*) mapping;
+    header = (const BytecodeHeader*) bytes;
+    if (memcmp(header->magic, "LBC", 4) != 0) {
+        return fail("Invalid bytecode file: " + fileName);
+    }
+    if (header->version != BYTECODE_VERSION) {
+        return fail("Stale bytecode file, it was written with version " + to_string(header->version)
+                    + " but version " + to_string(BYTECODE_VERSION) + " is required: " + fileName);
+    }
+
+    uint64_t expectedSize = sizeof(BytecodeHeader) + (uint64_t) header->instructionCount * sizeof(Instruction)
+                          + (uint64_t) header->constantCount * sizeof(int64_t)
+                          + (uint64_t) header->stringCount * sizeof(StringRef) + (uint64_t) header->lineCount * sizeof(LineRef)
+                          + (uint64_t) header->labelCount * sizeof(LabelRef) + header->dataSize;
+    if (expectedSize != mappingSize || header->instructionCount == 0 || (header->valueBits != 32 && header->valueBits != 64)
+        || fileChecksum(*header, bytes + sizeof(BytecodeHeader), mappingSize - sizeof(BytecodeHeader)) != header->checksum) {
+        return fail("Corrupt bytecode file: " + fileName);
+    }
+
+    instructions = (const Instruction*) (bytes + sizeof(BytecodeHeader));
+    constants = (const int64_t*) (instructions + header->instructionCount);
+    strings = (const StringRef*) (constants + header->constantCount);
+    lines = (const LineRef*) (strings + header->stringCount);
+    labels = (const LabelRef*) (lines + header->lineCount);
+    data = (const char*) (labels + header->labelCount);
+
+    // A matching checksum does not prove the file was written by LemASM, so check that nothing points outside of it.
+    bool valid = instructions[header->instructionCount - 1].opcode == Opcode::END;
+    for (uint32_t i = 0; i < header->instructionCount && valid; i++) {
+        const Instruction& instruction = instructions[i];
+        valid = (uint32_t) instruction.opcode < (uint32_t) OPCODE_COUNT
+             && (instruction.lineIndex == -1 || (uint32_t) instruction.lineIndex < header->lineCount)
+             && (instruction.opcode != Opcode::CPR || (uint32_t) instruction.operand < header->stringCount)
+             && (!isBulk(instruction.opcode) || instruction.operand >= 1)
+             && (instruction.opcode != Opcode::PSHW || (header->valueBits == 64 && (uint32_t) instruction.operand < header->constantCount))
+             && ((instruction.opcode != Opcode::JMP && !isConditionalJump(instruction.opcode)) || (uint32_t) instruction.target < header->instructionCount);
+    }
+    for (uint32_t i = 0; i < header->stringCount && valid; i++) {
+        valid = (uint64_t) strings[i].offset + strings[i].length <= header->dataSize;
+    }
+    for (uint32_t i = 0; i < header->lineCount && valid; i++) {
+        valid = (uint64_t) lines[i].offset + lines[i].length <= header->dataSize;
+    }
+    for (uint32_t i = 0; i < header->labelCount && valid; i++) {
+        valid = (uint64_t) labels[i].offset + labels[i].length <= header->dataSize && (uint32_t) labels[i].target < header->instructionCount;
+    }
+    if (!valid) {
+        return fail("Corrupt bytecode file: " + fileName);
+    }
+
+    return 0; // The file was loaded successfully.
+}
+
+/**
+ * Gets whether a file was loaded successfully.
+ * 
+ * @return True if a file is loaded, false otherwise.
+ */
+bool BytecodeFile::isLoaded() const {
+    return mapping != nullptr;
+}
+
+/**
+ * Gets the instructions of the loaded file.
+ * 
+ * @return The instructions, they end with an END instruction.
+ */
+const Instruction* BytecodeFile::getInstructions() {
+    return instructions;
+}
+
+/**
+ * Gets the number of instructions of the loaded file.
+ * 
+ * @return The number of instructions.
+ */
+int BytecodeFile::getInstructionCount() {
+    return header->instructionCount;
+}
+
+/**
+ * Gets the constants of the loaded file.
+ * 
+ * @return The literal of every PSHW operand.
+ */
+const int64_t* BytecodeFile::getConstants() {
+    return constants;
+}
+
+/**
+ * Gets the width of the values of the program of the loaded file.
+ * 
+ * @return 32 or 64.
+ */
+int BytecodeFile::getValueBits() {
+    return header->valueBits;
+}
+
+/**
+ * Gets the StringRefs of the loaded file.
+ * 
+ * @return The strings of the data section.
+ */
+const StringRef* BytecodeFile::getStrings() {
+    return strings;
+}
+
+/**
+ * Gets the LineRefs of the loaded file.
+ * 
+ * @return The lines the instructions were compiled from.
+ */
+const LineRef* BytecodeFile::getLines() {
+    return lines;
+}
+
+/**
+ * Gets the LabelRefs of the loaded file.
+ * 
+ * @return The labels of the code section.
+ */
+const LabelRef* BytecodeFile::getLabels() {
+    return labels;
+}
+
+/**
+ * Gets the number of labels of the loaded file.
+ * 
+ * @return The number of LabelRefs.
+ */
+int BytecodeFile::getLabelCount() {
+    return header->labelCount;
+}
+
+/**
+ * Gets the string data of the loaded file.
+ * 
+ * @return The string data the StringRefs, LineRefs and LabelRefs refer to.
+ */
+const char* BytecodeFile::getData() {
+    return data;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ErrorHandler.h"
+#include "Instruction.h"
+
+using namespace std;
+
+// The version of the bytecode format, files with any other version are rejected as stale.
+const uint32_t BYTECODE_VERSION = 8;
+
+// A string stored as an offset and length into the string data.
+struct StringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+// A source line stored as its line number, plus an offset and length of its contents in the string data.
+struct LineRef {
+    int32_t lineNumber;
+    uint32_t offset;
+    uint32_t length;
+};
+
+// A label of the code section stored as the index of the instruction it refers to, plus an offset and length of its name in the string data.
+struct LabelRef {
+    int32_t target;
+    uint32_t offset;
+    uint32_t length;
+};
+
+/**
+ * The header at the start of every bytecode (.lbc) file.
+ * It is followed by the instructions, the constants, the StringRefs, the LineRefs, the LabelRefs and finally the string data.
+ * All values are stored in the byte order of the machine, which is little-endian on every supported platform.
+ */
+struct BytecodeHeader {
+    char magic[4];             // Always "LBC" followed by a zero byte.
+    uint32_t version;          // The BYTECODE_VERSION the file was written with.
+    uint64_t checksum;         // The FNV-1a hash of the rest of the header and everything after it.
+    uint32_t valueBits;        // The width of the values of the program, 32 or 64.
+    uint32_t instructionCount; // The number of instructions, including the final END instruction.
+    uint32_t constantCount;    // The number of constants, one per literal of a PSHW.
+    uint32_t stringCount;      // The number of StringRefs, one per string of the data section.
+    uint32_t lineCount;        // The number of LineRefs, one per line an instruction was compiled from.
+    uint32_t labelCount;       // The number of LabelRefs, one per label of the code section.
+    uint64_t dataSize;         // The size of the string data in bytes.
+};
+
+class BytecodeFile {
+private:
+    void* mapping;
+    size_t mappingSize;
+    const BytecodeHeader* header;
+    const Instruction* instructions;
+    const int64_t* constants;
+    const StringRef* strings;
+    const LineRef* lines;
+    const LabelRef* labels;
+    const char* data;
+
+    static uint64_t fileChecksum(const BytecodeHeader& header, const char* payload, size_t size);
+
+public:
+    BytecodeFile();
+    ~BytecodeFile();
+
+    static uint64_t checksum(const char* bytes, size_t size, uint64_t hash = 14695981039346656037ULL);
+    static int write(string fileName, const vector<Instruction>& instructions, const vector<int64_t>& constants, const vector<StringRef>& strings,
+                     const vector<LineRef>& lines, const vector<LabelRef>& labels, const string& data, int valueBits);
+
+    int load(string fileName, ErrorHandler& errorHandler, bool reportErrors = true);
+    bool isLoaded() const;
+    const Instruction* getInstructions();
+    int getInstructionCount();
+    const int64_t* getConstants();
+    int getValueBits();
+    const StringRef* getStrings();
+    const LineRef* getLines();
+    const LabelRef* getLabels();
+    int getLabelCount();
+    const char* getData();
+};
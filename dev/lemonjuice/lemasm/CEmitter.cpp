@@ -0,0 +1,341 @@
+#include "CEmitter.h"
+#include <climits>
+#include <cstdio>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+#include "StackVerifier.h"
+
+using namespace std;
+
+// Constructor
+CEmitter::CEmitter(const vector<Instruction>& program, const Program& source, int stackSize, bool seeded, uint64_t seed, bool checked, bool trapOverflow)
+    : program(program), source(source), stackSize(stackSize), seeded(seeded), seed(seed), checked(checked), trapOverflow(trapOverflow) {}
+
+/**
+ * Quotes text as a C string literal.
+ * Every character that is not printable ASCII is written as an octal escape.
+ * 
+ * @param text The text to quote.
+ * @return The C string literal.
+ */
+string CEmitter::quote(const string& text) {
+    string quoted = "\"";
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c < 0x20 || c >= 0x7F || c == '?') {
+            char escape[5];
+            snprintf(escape, sizeof(escape), "\\%03o", c);
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+/**
+ * Makes text safe to put inside a C comment.
+ * 
+ * @param text The text to put in a comment.
+ * @return The text, with every end of comment sequence broken up.
+ */
+static string commentSafe(string text) {
+    for (size_t position = text.find("*/"); position != string::npos; position = text.find("*/")) text.replace(position, 2, "* /");
+    return text;
+}
+
+/**
+ * Emits a runtime check that reports an error the same way the ErrorHandler does, then exits with 1.
+ * 
+ * @param out The stream to write to.
+ * @param condition The C condition that means the instruction fails.
+ * @param errorMessage The error message to report.
+ * @param instruction The instruction that is checked.
+ */
+void CEmitter::emitCheck(ostream& out, const string& condition, const string& errorMessage, const Instruction& instruction) {
+    Line line = source.lineAt(instruction.lineIndex);
+    out << "    if (" << condition << ") return lemasmError(" << quote(errorMessage) << ", " << line.getLineNumber() << ", "
+        << quote(line.getContents()) << ");" << endl;
+}
+
+/**
+ * Emits an addition, subtraction or multiplication that stores its result in left.
+ * It is done on unsigned values so that overflow wraps like it does in the interpreter, instead of being undefined,
+ * or with a checked builtin that stops with an error if overflow is trapped.
+ * 
+ * @param out The stream to write to.
+ * @param builtin The checked builtin, for example "__builtin_add_overflow".
+ * @param symbol The C operator, for example '+'.
+ * @param left The left value, which receives the result.
+ * @param right The right value.
+ * @param instruction The instruction that is emitted.
+ */
+void CEmitter::emitArithmetic(ostream& out, const string& builtin, char symbol, const string& left, const string& right, const Instruction& instruction) {
+    if (trapOverflow) {
+        emitCheck(out, builtin + "(" + left + ", (lemasmValue) " + right + ", &" + left + ")",
+            "Integer overflow, the result does not fit in " + to_string(source.getValueBits()) + " bits.", instruction);
+    } else {
+        out << "    " << left << " = (lemasmValue) ((lemasmUnsigned) " << left << " " << symbol << " (lemasmUnsigned) " << right << ");" << endl;
+    }
+}
+
+/**
+ * Emits the C statements for a single instruction.
+ * 
+ * @param out The stream to write to.
+ * @param index The index of the instruction.
+ */
+void CEmitter::emitInstruction(ostream& out, int index) {
+    const Instruction& instruction = program[index];
+    string target = "L" + to_string(instruction.target);
+    string operand = to_string(instruction.operand);
+    if (instruction.operand == INT_MIN) operand = "(-2147483647 - 1)";
+
+    if (instruction.lineIndex >= 0) {
+        Line line = source.lineAt(instruction.lineIndex);
+        out << "    /* " << line.getLineNumber() << ": " << commentSafe(line.getContents()) << " */" << endl;
+    }
+
+    int required = stackRequired(instruction);
+    int effect = stackEffect(instruction);
+    string overflowMessage = "Integer overflow, the result does not fit in " + to_string(source.getValueBits()) + " bits.";
+    if (checked && required > 0) {
+        emitCheck(out, "sp - stack < " + to_string(required), StackVerifier::underflowMessage(instruction.opcode), instruction);
+    }
+    if (checked && effect > 0) {
+        emitCheck(out, effect == 1 ? "sp == stack + STACK_SIZE" : "stack + STACK_SIZE - sp < " + to_string(effect),
+            "Stack overflow, the stack can hold at most " + to_string(stackSize) + " values.", instruction);
+    }
+
+    if (instruction.opcode == Opcode::DIV || instruction.opcode == Opcode::MOD) {
+        emitCheck(out, "sp[-1] == 0", "Division by zero.", instruction);
+        if (trapOverflow && instruction.opcode == Opcode::DIV) emitCheck(out, "sp[-1] == -1 && sp[-2] == VALUE_MIN", overflowMessage, instruction);
+    }
+
+    switch (instruction.opcode) {
+        case Opcode::ADD: emitArithmetic(out, "__builtin_add_overflow", '+', "sp[-2]", "sp[-1]", instruction); out << "    sp--;" << endl; break;
+        case Opcode::SUB: emitArithmetic(out, "__builtin_sub_overflow", '-', "sp[-2]", "sp[-1]", instruction); out << "    sp--;" << endl; break;
+        case Opcode::MUL: emitArithmetic(out, "__builtin_mul_overflow", '*', "sp[-2]", "sp[-1]", instruction); out << "    sp--;" << endl; break;
+        // The smallest value divided by -1 wraps around to itself, and anything modulo -1 is 0, like in the interpreter.
+        case Opcode::DIV: out << "    sp[-2] = sp[-1] == -1 ? (lemasmValue) (0 - (lemasmUnsigned) sp[-2]) : sp[-2] / sp[-1]; sp--;" << endl; break;
+        case Opcode::MOD: out << "    sp[-2] = sp[-1] == -1 ? 0 : sp[-2] % sp[-1]; sp--;" << endl; break;
+        case Opcode::CPK: out << "    printf(VALUE_FORMAT, sp[-1]);" << endl; break;
+        case Opcode::CPP: out << "    sp--; printf(VALUE_FORMAT, *sp);" << endl; break;
+        case Opcode::CPR: out << "    puts(string" << operand << ");" << endl; break;
+        case Opcode::DUP: out << "    *sp = sp[-1]; sp++;" << endl; break;
+        case Opcode::FLS: out << "    fflush(stdout);" << endl; break;
+        case Opcode::JEQ: out << "    sp -= 2; if (sp[1] == sp[0]) goto " << target << ";" << endl; break;
+        case Opcode::JGT: out << "    sp -= 2; if (sp[0] > sp[1]) goto " << target << ";" << endl; break;
+        case Opcode::JLT: out << "    sp -= 2; if (sp[0] < sp[1]) goto " << target << ";" << endl; break;
+        case Opcode::JNE: out << "    sp -= 2; if (sp[1] != sp[0]) goto " << target << ";" << endl; break;
+        case Opcode::JMP: out << "    goto " << target << ";" << endl; break;
+        case Opcode::PSH: out << "    *sp++ = " << operand << ";" << endl; break;
+        case Opcode::POP: out << "    sp--;" << endl; break;
+        case Opcode::RAN: out << "    *sp++ = (int) (nextRandom() >> 33);" << endl; break;
+        case Opcode::RET: out << "    return sp == stack ? 0 : (int) sp[-1];" << endl; break;
+        case Opcode::ROR: out << "    shuffle(sp);" << endl; break;
+        case Opcode::SWP: out << "    { lemasmValue a = sp[-1]; sp[-1] = sp[-2]; sp[-2] = a; }" << endl; break;
+        case Opcode::SUM:
+        case Opcode::PRD: {
+            string call = string(instruction.opcode == Opcode::SUM ? "bulkSum" : "bulkProduct") + "(sp, " + operand + ")";
+            if (trapOverflow) emitCheck(out, call, overflowMessage, instruction);
+            else out << "    " << call << ";" << endl;
+            out << "    sp -= " << instruction.operand - 1 << ";" << endl;
+            break;
+        }
+        case Opcode::MIN: out << "    bulkMinimum(sp, " << operand << "); sp -= " << instruction.operand - 1 << ";" << endl; break;
+        case Opcode::MAX: out << "    bulkMaximum(sp, " << operand << "); sp -= " << instruction.operand - 1 << ";" << endl; break;
+        case Opcode::FIL: out << "    sp = bulkFill(sp, " << operand << ");" << endl; break;
+        case Opcode::SEQ:
+            if (trapOverflow) emitCheck(out, "sp[-1] > VALUE_MAX - " + to_string(instruction.operand - 1), overflowMessage, instruction);
+            out << "    sp = bulkSequence(sp, " << operand << ");" << endl;
+            break;
+        case Opcode::REV: out << "    bulkReverse(sp, " << operand << ");" << endl; break;
+        case Opcode::END: out << "    return 0;" << endl; break;
+        case Opcode::ADDI: emitArithmetic(out, "__builtin_add_overflow", '+', "sp[-1]", operand, instruction); break;
+        case Opcode::SUBI: emitArithmetic(out, "__builtin_sub_overflow", '-', "sp[-1]", operand, instruction); break;
+        case Opcode::MULI: emitArithmetic(out, "__builtin_mul_overflow", '*', "sp[-1]", operand, instruction); break;
+        case Opcode::JEQI: out << "    if (*--sp == " << operand << ") goto " << target << ";" << endl; break;
+        case Opcode::JGTI: out << "    if (*--sp > " << operand << ") goto " << target << ";" << endl; break;
+        case Opcode::JLTI: out << "    if (*--sp < " << operand << ") goto " << target << ";" << endl; break;
+        case Opcode::JNEI: out << "    if (*--sp != " << operand << ") goto " << target << ";" << endl; break;
+        case Opcode::JEQK: out << "    if (sp[-1] == " << operand << ") goto " << target << ";" << endl; break;
+        case Opcode::JGTK: out << "    if (sp[-1] > " << operand << ") goto " << target << ";" << endl; break;
+        case Opcode::JLTK: out << "    if (sp[-1] < " << operand << ") goto " << target << ";" << endl; break;
+        case Opcode::JNEK: out << "    if (sp[-1] != " << operand << ") goto " << target << ";" << endl; break;
+        case Opcode::PSHW: {
+            int64_t constant = source.constantAt(instruction.operand);
+            if (constant == INT64_MIN) out << "    *sp++ = VALUE_MIN;" << endl;
+            else out << "    *sp++ = " << constant << "LL;" << endl;
+            break;
+        }
+    }
+}
+
+/**
+ * Emits the helper function of a bulk opcode, the helpers work on the top n values below sp.
+ * With overflow trapping, bulkSum and bulkProduct return 1 if they overflow, exactly when a chain of ADDs or MULs would.
+ * 
+ * @param out The stream to write to.
+ * @param opcode The bulk opcode.
+ */
+void CEmitter::emitBulkHelper(ostream& out, Opcode opcode) {
+    switch (opcode) {
+        case Opcode::SUM:
+        case Opcode::PRD: {
+            string name = opcode == Opcode::SUM ? "bulkSum" : "bulkProduct";
+            if (trapOverflow) {
+                string builtin = opcode == Opcode::SUM ? "__builtin_add_overflow" : "__builtin_mul_overflow";
+                out << "static int " << name << "(lemasmValue* sp, long n) {" << endl;
+                out << "    lemasmValue result = sp[-1];" << endl;
+                out << "    for (long i = 2; i <= n; i++) if (" << builtin << "(sp[-i], result, &result)) return 1;" << endl;
+                out << "    sp[-n] = result;" << endl;
+                out << "    return 0;" << endl;
+            } else {
+                out << "static void " << name << "(lemasmValue* sp, long n) {" << endl;
+                out << "    lemasmUnsigned result = " << (opcode == Opcode::SUM ? "0" : "1") << ";" << endl;
+                out << "    for (long i = 1; i <= n; i++) result " << (opcode == Opcode::SUM ? "+" : "*") << "= (lemasmUnsigned) sp[-i];" << endl;
+                out << "    sp[-n] = (lemasmValue) result;" << endl;
+            }
+            break;
+        }
+        case Opcode::MIN:
+        case Opcode::MAX:
+            out << "static void " << (opcode == Opcode::MIN ? "bulkMinimum" : "bulkMaximum") << "(lemasmValue* sp, long n) {" << endl;
+            out << "    lemasmValue result = sp[-1];" << endl;
+            out << "    for (long i = 2; i <= n; i++) if (sp[-i] " << (opcode == Opcode::MIN ? "<" : ">") << " result) result = sp[-i];" << endl;
+            out << "    sp[-n] = result;" << endl;
+            break;
+        case Opcode::FIL:
+            out << "static lemasmValue* bulkFill(lemasmValue* sp, long n) {" << endl;
+            out << "    for (long i = 0; i < n - 1; i++) sp[i] = sp[-1];" << endl;
+            out << "    return sp + n - 1;" << endl;
+            break;
+        case Opcode::SEQ:
+            out << "static lemasmValue* bulkSequence(lemasmValue* sp, long n) {" << endl;
+            out << "    lemasmUnsigned start = (lemasmUnsigned) sp[-1];" << endl;
+            out << "    for (long i = 1; i < n; i++) sp[i - 1] = (lemasmValue) (start + (lemasmUnsigned) i);" << endl;
+            out << "    return sp + n - 1;" << endl;
+            break;
+        case Opcode::REV:
+            out << "static void bulkReverse(lemasmValue* sp, long n) {" << endl;
+            out << "    for (long i = 0; i < n / 2; i++) { lemasmValue a = sp[i - n]; sp[i - n] = sp[-1 - i]; sp[-1 - i] = a; }" << endl;
+            break;
+        default:
+            return;
+    }
+    out << "}" << endl << endl;
+}
+
+/**
+ * Emits the program as a standalone C file, which can be compiled with any C compiler, for example "gcc -O2 out.c".
+ * 
+ * The strings of the data section become static constants, and every instruction becomes straight-line C,
+ * with a goto label in front of every instruction that is jumped to.
+ * The compiled program prints the same output and exits with the same code as the interpreter would.
+ * The bulk opcodes become calls to small helper functions, which the C compiler is free to vectorize.
+ * Values are int or long long, depending on the width of the program, and arithmetic can trap overflow with the checked builtins of GCC and Clang.
+ * RAN and ROR use the same generator as the interpreter (see Random), so with a seed they draw the same numbers too,
+ * without one the generator is seeded from the time the compiled program starts.
+ * 
+ * @param out The stream to write to.
+ * @param sourceName The name of the LemASM file, it is only used in a comment.
+ */
+void CEmitter::emit(ostream& out, string sourceName) {
+    vector<bool> isTarget(program.size(), false);
+    bool usesError = checked || trapOverflow; // Whether the program can report an error.
+    bool usesShuffle = false; // Whether the program uses ROR.
+    bool usesRandom = false; // Whether the program uses RAN or ROR.
+    set<Opcode> bulkOpcodes; // The bulk opcodes the program uses.
+    for (const Instruction& instruction : program) {
+        if (instruction.opcode == Opcode::JMP || isConditionalJump(instruction.opcode)) isTarget[instruction.target] = true;
+        if (instruction.opcode == Opcode::ROR) usesShuffle = true;
+        if (isBulk(instruction.opcode)) bulkOpcodes.insert(instruction.opcode);
+        if (instruction.opcode == Opcode::DIV || instruction.opcode == Opcode::MOD) usesError = true;
+        if (instruction.opcode == Opcode::RAN || instruction.opcode == Opcode::ROR) usesRandom = true;
+    }
+
+    out << "/* Generated by LemASM from " << sourceName << ", do not edit. */" << endl;
+    out << "#include <stdio.h>" << endl;
+    out << "#include <stdlib.h>" << endl;
+    if (usesRandom && !seeded) out << "#include <time.h>" << endl;
+    out << endl;
+    out << "#define STACK_SIZE " << stackSize << endl << endl;
+    if (source.getValueBits() == 64) {
+        out << "typedef long long lemasmValue;" << endl;
+        out << "typedef unsigned long long lemasmUnsigned;" << endl;
+        out << "#define VALUE_MIN (-9223372036854775807LL - 1)" << endl;
+        out << "#define VALUE_MAX 9223372036854775807LL" << endl;
+        out << "#define VALUE_FORMAT \"%lld\\n\"" << endl << endl;
+    } else {
+        out << "typedef int lemasmValue;" << endl;
+        out << "typedef unsigned lemasmUnsigned;" << endl;
+        out << "#define VALUE_MIN (-2147483647 - 1)" << endl;
+        out << "#define VALUE_MAX 2147483647" << endl;
+        out << "#define VALUE_FORMAT \"%d\\n\"" << endl << endl;
+    }
+
+    out << "/* Data Section */" << endl;
+    for (auto const& x : source.getStringMap()) {
+        out << "static const char string" << x.second << "[] = " << quote(source.stringAt(x.second)) << "; /* " << commentSafe(x.first) << " */" << endl;
+    }
+    out << endl;
+
+    out << "static lemasmValue stack[STACK_SIZE];" << endl << endl;
+    if (usesError) {
+        out << "static int lemasmError(const char* message, int lineNumber, const char* lineContents) {" << endl;
+        out << "    fflush(stdout);" << endl;
+        out << "    fprintf(stderr, \"\\033[1;31mError: \\033[0m\\033[31m%s\\033[0m\\n\\033[31mAt line: %d\\033[0m\\n\\033[31m%s\\033[0m\\n\", "
+            << "message, lineNumber, lineContents);" << endl;
+        out << "    return 1;" << endl;
+        out << "}" << endl << endl;
+    }
+    if (usesRandom) {
+        out << "static unsigned long long randomState[4];" << endl << endl;
+        out << "static void seedRandom(unsigned long long seed) {" << endl;
+        out << "    for (int i = 0; i < 4; i++) {" << endl;
+        out << "        unsigned long long z = seed += 0x9E3779B97F4A7C15ull;" << endl;
+        out << "        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;" << endl;
+        out << "        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;" << endl;
+        out << "        randomState[i] = z ^ (z >> 31);" << endl;
+        out << "    }" << endl;
+        out << "}" << endl << endl;
+        out << "static unsigned long long nextRandom(void) {" << endl;
+        out << "    unsigned long long *s = randomState, result = s[1] * 5, shifted = s[1] << 17;" << endl;
+        out << "    result = ((result << 7) | (result >> 57)) * 9;" << endl;
+        out << "    s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3]; s[2] ^= shifted;" << endl;
+        out << "    s[3] = (s[3] << 45) | (s[3] >> 19);" << endl;
+        out << "    return result;" << endl;
+        out << "}" << endl << endl;
+    }
+    if (usesShuffle) {
+        out << "static unsigned long long randomBelow(unsigned long long bound) {" << endl;
+        out << "    unsigned long long threshold = -bound % bound, draw = nextRandom();" << endl;
+        out << "    while (draw < threshold) draw = nextRandom();" << endl;
+        out << "    return draw % bound;" << endl;
+        out << "}" << endl << endl;
+        out << "static void shuffle(lemasmValue* sp) {" << endl;
+        out << "    for (long i = sp - stack - 1; i > 0; i--) {" << endl;
+        out << "        long j = (long) randomBelow(i + 1);" << endl;
+        out << "        lemasmValue a = stack[i]; stack[i] = stack[j]; stack[j] = a;" << endl;
+        out << "    }" << endl;
+        out << "}" << endl << endl;
+    }
+
+    for (Opcode opcode : bulkOpcodes) emitBulkHelper(out, opcode);
+
+    out << "/* Code Section */" << endl;
+    out << "int main(void) {" << endl;
+    out << "    lemasmValue* sp = stack;" << endl;
+    if (usesRandom && seeded) out << "    seedRandom(" << seed << "ull);" << endl;
+    else if (usesRandom) out << "    seedRandom((unsigned long long) time(NULL));" << endl;
+    for (int i = 0; i < program.size(); i++) {
+        if (isTarget[i]) out << "L" << i << ":" << endl;
+        emitInstruction(out, i);
+    }
+    out << "}" << endl;
+}
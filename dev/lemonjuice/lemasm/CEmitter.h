@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Instruction.h"
+#include "Line.h"
+#include "Program.h"
+
+using namespace std;
+
+class CEmitter {
+private:
+    const vector<Instruction>& program;
+    const Program& source;
+    int stackSize;
+    bool seeded;
+    uint64_t seed;
+    bool checked;
+    bool trapOverflow;
+
+    void emitInstruction(ostream& out, int index);
+    void emitCheck(ostream& out, const string& condition, const string& errorMessage, const Instruction& instruction);
+    void emitBulkHelper(ostream& out, Opcode opcode);
+    void emitArithmetic(ostream& out, const string& builtin, char symbol, const string& left, const string& right, const Instruction& instruction);
+
+public:
+    CEmitter(const vector<Instruction>& program, const Program& source, int stackSize, bool seeded, uint64_t seed, bool checked, bool trapOverflow);
+    void emit(ostream& out, string sourceName);
+
+    static string quote(const string& text);
+};
@@ -0,0 +1,67 @@
+#include "Context.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// Constructor
+Context::Context(int stackSize)
+    : stackSize(stackSize), stack(new int[stackSize]), failed(false), depth(0), valueBits(32), resuming(false), resumePc(0), resumeDepth(0), resumeSteps(0),
+      nextSnapshot(0), snapshotWriter(-1) {}
+
+/**
+ * Gets the number of values the stack can hold.
+ * 
+ * @return The stack size.
+ */
+int Context::getStackSize() const {
+    return stackSize;
+}
+
+/**
+ * Gets the stack of 64-bit programs, it is allocated the first time it is needed.
+ * 
+ * @return The bottom of the stack.
+ */
+int64_t* Context::getWideStack() {
+    if (wideStack == nullptr) wideStack.reset(new int64_t[stackSize]);
+    return wideStack.get();
+}
+
+/**
+ * Gets the buffered writer that the program prints through, it writes to the console unless it was opened on a file.
+ * 
+ * @return The output buffer.
+ */
+OutputBuffer& Context::getOutput() {
+    return output;
+}
+
+/**
+ * Gets the statistics of the last run, they are only collected if VMOptions::statsMode is set.
+ * 
+ * @return The statistics.
+ */
+Statistics& Context::getStatistics() {
+    return statistics;
+}
+
+/**
+ * Gets whether the last run stopped with a runtime error.
+ * 
+ * @return True if the last run failed, false otherwise.
+ */
+bool Context::hasFailed() const {
+    return failed;
+}
+
+/**
+ * Gets the values the last run left on the stack, they are only known if it returned with RET or reached the end of the program.
+ * 
+ * @return The values, the bottom one first, or none if the last run failed.
+ */
+vector<int64_t> Context::getStack() {
+    if (valueBits == 64) return vector<int64_t>(getWideStack(), getWideStack() + depth);
+    return vector<int64_t>(stack.get(), stack.get() + depth);
+}
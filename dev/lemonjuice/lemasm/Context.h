@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "OutputBuffer.h"
+#include "Profiler.h"
+#include "Random.h"
+#include "Statistics.h"
+#include "Tracer.h"
+#include <sys/types.h>
+
+using namespace std;
+
+/**
+ * Everything a single run of a Program changes: the stack, the output, the random number generator, the profiler, the tracer and the statistics.
+ * A context can be reused for any number of runs, every run starts with an empty stack unless it resumes a snapshot.
+ * The stack of 64-bit programs is only allocated once a 64-bit program runs in the context.
+ * Contexts are independent of each other, so different contexts can run programs at the same time.
+ */
+class Context {
+private:
+    friend class LemVM;
+
+    int stackSize;
+    unique_ptr<int[]> stack;
+    unique_ptr<int64_t[]> wideStack;
+    OutputBuffer output;
+    Random random;
+    Profiler profiler;
+    Tracer tracer;
+    Statistics statistics;
+    bool failed;
+    int64_t depth; // The depth of the stack when the last run returned, see getStack().
+    int valueBits; // The width of the values of the last run.
+
+    // Where the next run starts, it is only set by LemVM::resume(), see Snapshot.
+    bool resuming;
+    int resumePc;
+    int64_t resumeDepth;
+    int64_t resumeSteps;
+
+    int64_t nextSnapshot; // The step count at which the next snapshot is taken.
+    pid_t snapshotWriter; // The child process that is writing the last snapshot, or -1 if there is none.
+
+    int64_t* getWideStack();
+
+public:
+    static const int DEFAULT_STACK_SIZE = 1 << 20;
+
+    Context(int stackSize = DEFAULT_STACK_SIZE);
+    int getStackSize() const;
+    OutputBuffer& getOutput();
+    Statistics& getStatistics();
+    bool hasFailed() const;
+    vector<int64_t> getStack();
+};
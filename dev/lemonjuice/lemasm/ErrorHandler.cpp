@@ -4,6 +4,9 @@
 
 using namespace std;
 
+// Where the errors of the current thread are written instead of the error stream, see capture().
+thread_local string* capturedErrors = nullptr;
+
 // Constructor 
 ErrorHandler::ErrorHandler() {}
 
@@ -34,7 +37,9 @@ string ErrorHandler::applyErrorStyle(string text, bool bold){
  * @param errorMessage The error message to display.
  */
 void ErrorHandler::handleErrorNoLine(string errorMessage) {
-    cerr << applyErrorStyle("Error: ", true) << applyErrorStyle(errorMessage, false) << endl;
+    string error = applyErrorStyle("Error: ", true) + applyErrorStyle(errorMessage, false) + "\n";
+    if (capturedErrors != nullptr) capturedErrors->append(error);
+    else cerr << error << flush;
 }
 
 /**
@@ -47,7 +52,19 @@ void ErrorHandler::handleErrorNoLine(string errorMessage) {
  */
 void ErrorHandler::handleErrorWithLine(string errorMessage, int lineNumber, string lineContents) {
     string lineNumberString = "At line: " + to_string(lineNumber);
-    cerr << applyErrorStyle("Error: ", true) << applyErrorStyle(errorMessage, false) << endl 
-         << applyErrorStyle(lineNumberString, false) << endl
-         << applyErrorStyle(lineContents, false) << endl;
+    string error = applyErrorStyle("Error: ", true) + applyErrorStyle(errorMessage, false) + "\n"
+                 + applyErrorStyle(lineNumberString, false) + "\n"
+                 + applyErrorStyle(lineContents, false) + "\n";
+    if (capturedErrors != nullptr) capturedErrors->append(error);
+    else cerr << error << flush;
+}
+
+/**
+ * Makes every error handler write the errors of the current thread to a string instead of the error stream,
+ * so that a thread running one of many programs can keep its errors apart from those of the others.
+ * 
+ * @param errors The string to append the errors to, or nullptr to write them to the error stream again.
+ */
+void ErrorHandler::capture(string* errors) {
+    capturedErrors = errors;
 }
\ No newline at end of file
@@ -14,4 +14,7 @@ public:
     // Error Handling
     void handleErrorNoLine(string errorMessage);
     void handleErrorWithLine(string errorMessage, int lineNumber, string lineContents);
+
+    // Error Capture
+    static void capture(string* errors);
 };
@@ -0,0 +1,201 @@
+#pragma once
+#include <string>
+
+using namespace std;
+
+/**
+ * The opcodes that code section mnemonics are compiled to.
+ * There is one opcode per mnemonic, labels, comments and whitespace lines are dropped at compile time.
+ * The opcodes after END have no mnemonic: PSHW is produced by the compiler, the others are superinstructions produced by the Optimizer.
+ * The order of the opcodes must match the dispatch table in LemVM::executeProgram() in LemVM.cpp.
+ */
+enum class Opcode {
+    ADD, // Add
+    CPK, // Console Peek
+    CPP, // Console Pop
+    CPR, // Console Print
+    DIV, // Divide
+    DUP, // Duplicate
+    FLS, // Flush
+    JEQ, // Jump Equal
+    JGT, // Jump Greater Than
+    JLT, // Jump Less Than
+    JMP, // Jump
+    JNE, // Jump Not Equal
+    MOD, // Modulus
+    MUL, // Multiply
+    PSH, // Push
+    POP, // Pop
+    RAN, // Random
+    RET, // Return
+    ROR, // Randomize Order
+    SUB, // Subtract
+    SWP, // Swap
+    SUM, // Sum
+    PRD, // Product
+    MIN, // Minimum
+    MAX, // Maximum
+    FIL, // Fill
+    SEQ, // Sequence
+    REV, // Reverse
+    END, // End of the program, this has no mnemonic and is appended by the compiler.
+    ADDI, // PSH n, ADD
+    SUBI, // PSH n, SUB
+    MULI, // PSH n, MUL
+    JEQI, // PSH n, JEQ
+    JGTI, // PSH n, JGT
+    JLTI, // PSH n, JLT
+    JNEI, // PSH n, JNE
+    JEQK, // DUP, PSH n, JEQ
+    JGTK, // DUP, PSH n, JGT
+    JLTK, // DUP, PSH n, JLT
+    JNEK, // DUP, PSH n, JNE
+    PSHW  // PSH n, where n does not fit in 32 bits, it only appears in 64-bit programs.
+};
+
+// The number of opcodes, this must be updated whenever an opcode is added after PSHW.
+const int OPCODE_COUNT = (int) Opcode::PSHW + 1;
+
+/**
+ * Gets the name of an opcode, which is its mnemonic for the opcodes that have one.
+ * 
+ * @param opcode The opcode.
+ * @return The name of the opcode.
+ */
+inline const char* opcodeName(Opcode opcode) {
+    static const char* const names[OPCODE_COUNT] = {
+        "ADD", "CPK", "CPP", "CPR", "DIV", "DUP", "FLS", "JEQ", "JGT", "JLT", "JMP", "JNE",
+        "MOD", "MUL", "PSH", "POP", "RAN", "RET", "ROR", "SUB", "SWP", "SUM", "PRD", "MIN", "MAX", "FIL", "SEQ", "REV", "END",
+        "ADDI", "SUBI", "MULI", "JEQI", "JGTI", "JLTI", "JNEI", "JEQK", "JGTK", "JLTK", "JNEK", "PSHW"
+    };
+    return names[(int) opcode];
+}
+
+/**
+ * A single pre-decoded code section instruction.
+ * 
+ * The operand is interpreted per opcode:
+ * - PSH and the superinstructions use it as the immediate value.
+ * - PSHW uses it as an index into the constants of the program, which hold the literals that do not fit in 32 bits.
+ * - The bulk opcodes (see isBulk()) use it as the number of values they work on, which is at least 1.
+ * - CPR uses it as an index into the strings of the data section.
+ * - Every other opcode ignores it.
+ * 
+ * The target is the index of the instruction to jump to, it is only used by the jumps.
+ * 
+ * The line index points back into the vector of lines so errors can still report the original line.
+ */
+struct Instruction {
+    Opcode opcode;
+    int operand;
+    int target;
+    int lineIndex;
+};
+
+/**
+ * Gets whether an opcode is a conditional jump, which either jumps to its target or continues with the next instruction.
+ * 
+ * @param opcode The opcode.
+ * @return True if the opcode is a conditional jump, false otherwise.
+ */
+inline bool isConditionalJump(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::JEQ: case Opcode::JGT: case Opcode::JLT: case Opcode::JNE:
+        case Opcode::JEQI: case Opcode::JGTI: case Opcode::JLTI: case Opcode::JNEI:
+        case Opcode::JEQK: case Opcode::JGTK: case Opcode::JLTK: case Opcode::JNEK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Gets whether an opcode is a bulk opcode, which works on as many values as its operand says in a single instruction.
+ * 
+ * @param opcode The opcode.
+ * @return True if the opcode is a bulk opcode, false otherwise.
+ */
+inline bool isBulk(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::SUM: case Opcode::PRD: case Opcode::MIN: case Opcode::MAX: case Opcode::FIL: case Opcode::SEQ: case Opcode::REV:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Gets how many values must be on the stack for an opcode to execute.
+ * The bulk opcodes depend on their operand as well, see the Instruction overload.
+ * 
+ * @param opcode The opcode.
+ * @return The number of values the opcode reads from the stack.
+ */
+inline int stackRequired(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::ADD: case Opcode::DIV: case Opcode::MOD: case Opcode::MUL: case Opcode::SUB: case Opcode::SWP:
+        case Opcode::JEQ: case Opcode::JGT: case Opcode::JLT: case Opcode::JNE:
+            return 2;
+        case Opcode::CPK: case Opcode::CPP: case Opcode::DUP: case Opcode::POP: case Opcode::FIL: case Opcode::SEQ:
+        case Opcode::ADDI: case Opcode::SUBI: case Opcode::MULI:
+        case Opcode::JEQI: case Opcode::JGTI: case Opcode::JLTI: case Opcode::JNEI:
+        case Opcode::JEQK: case Opcode::JGTK: case Opcode::JLTK: case Opcode::JNEK:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Gets how much an opcode changes the depth of the stack.
+ * The bulk opcodes depend on their operand as well, see the Instruction overload.
+ * 
+ * @param opcode The opcode.
+ * @return The number of values the opcode adds to (positive) or removes from (negative) the stack.
+ */
+inline int stackEffect(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::DUP: case Opcode::PSH: case Opcode::PSHW: case Opcode::RAN:
+            return 1;
+        case Opcode::ADD: case Opcode::DIV: case Opcode::MOD: case Opcode::MUL: case Opcode::SUB:
+        case Opcode::CPP: case Opcode::POP:
+        case Opcode::JEQI: case Opcode::JGTI: case Opcode::JLTI: case Opcode::JNEI:
+            return -1;
+        case Opcode::JEQ: case Opcode::JGT: case Opcode::JLT: case Opcode::JNE:
+            return -2;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Gets how many values must be on the stack for an instruction to execute, which for the bulk opcodes depends on their operand.
+ * 
+ * @param instruction The instruction.
+ * @return The number of values the instruction reads from the stack.
+ */
+inline int stackRequired(const Instruction& instruction) {
+    switch (instruction.opcode) {
+        case Opcode::SUM: case Opcode::PRD: case Opcode::MIN: case Opcode::MAX: case Opcode::REV:
+            return instruction.operand;
+        default:
+            return stackRequired(instruction.opcode);
+    }
+}
+
+/**
+ * Gets how much an instruction changes the depth of the stack, which for the bulk opcodes depends on their operand.
+ * 
+ * @param instruction The instruction.
+ * @return The number of values the instruction adds to (positive) or removes from (negative) the stack.
+ */
+inline int stackEffect(const Instruction& instruction) {
+    switch (instruction.opcode) {
+        case Opcode::SUM: case Opcode::PRD: case Opcode::MIN: case Opcode::MAX:
+            return 1 - instruction.operand;
+        case Opcode::FIL: case Opcode::SEQ:
+            return instruction.operand - 1;
+        default:
+            return stackEffect(instruction.opcode);
+    }
+}
@@ -0,0 +1,381 @@
+#include "JitCompiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef LEMASM_JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+static_assert(offsetof(JitContext, stackBase) == 0, "The compiled code expects stackBase at offset 0.");
+static_assert(offsetof(JitContext, stackLimit) == 8, "The compiled code expects stackLimit at offset 8.");
+static_assert(offsetof(JitContext, sp) == 16, "The compiled code expects sp at offset 16.");
+static_assert(offsetof(JitContext, errorIndex) == 24, "The compiled code expects errorIndex at offset 24.");
+static_assert(offsetof(JitContext, errorKind) == 28, "The compiled code expects errorKind at offset 28.");
+
+/*
+ * The runtime helpers the compiled code calls for everything that is not plain arithmetic.
+ * They behave exactly like the matching handlers of the execution loop, LemVM::executeProgram() in LemVM.cpp.
+ */
+static void jitPrintInt(OutputBuffer* output, int value) {
+    output->writeLine(value);
+}
+
+static void jitPrintString(OutputBuffer* output, const char* data, uint32_t length) {
+    output->writeLine(data, length);
+}
+
+static void jitFlush(OutputBuffer* output) {
+    output->flush();
+}
+
+static int jitRandom(Random* random) {
+    return random->nextInt();
+}
+
+static void jitShuffle(Random* random, int* stackBase, int* sp) {
+    random->shuffle(stackBase, sp);
+}
+
+// Constructor
+JitCompiler::JitCompiler(): buffer(nullptr), bufferSize(0) {}
+
+// Destructor
+JitCompiler::~JitCompiler() {
+#ifdef LEMASM_JIT_SUPPORTED
+    if (buffer != nullptr) munmap(buffer, bufferSize);
+#endif
+}
+
+/**
+ * Appends raw bytes to the code.
+ * 
+ * @param bytes The bytes to append.
+ */
+void JitCompiler::emit(initializer_list<uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+}
+
+/**
+ * Appends a little-endian 32-bit value to the code.
+ * 
+ * @param value The value to append.
+ */
+void JitCompiler::emit32(int32_t value) {
+    uint8_t bytes[4];
+    memcpy(bytes, &value, 4);
+    code.insert(code.end(), bytes, bytes + 4);
+}
+
+/**
+ * Appends a little-endian 64-bit value to the code.
+ * 
+ * @param value The value to append.
+ */
+void JitCompiler::emit64(uint64_t value) {
+    uint8_t bytes[8];
+    memcpy(bytes, &value, 8);
+    code.insert(code.end(), bytes, bytes + 8);
+}
+
+/**
+ * Appends a jump with a 32-bit displacement that still has to be patched.
+ * 
+ * @param opcode The opcode bytes of the jump.
+ * @return The position of the displacement in the code.
+ */
+size_t JitCompiler::emitJump(initializer_list<uint8_t> opcode) {
+    emit(opcode);
+    size_t position = code.size();
+    emit32(0);
+    return position;
+}
+
+/**
+ * Appends a call to a runtime helper.
+ * 
+ * @param function The address of the helper.
+ */
+void JitCompiler::emitCall(const void* function) {
+    emit({0x48, 0xB8}); // mov rax, imm64
+    emit64((uint64_t) function);
+    emit({0xFF, 0xD0}); // call rax
+}
+
+/**
+ * Compiles the program to x86-64 machine code.
+ * 
+ * Every instruction is translated by a fixed template, the operand stack stays in the regular stack array:
+ * - rbx holds the stack pointer (one past the top value), r12 the stack base and r13 the stack limit.
+ * - r14 holds the JitContext, the stack pointer is written back to it when the compiled code returns.
+ * - Jumps are translated to native jumps, so a taken branch costs a single jmp or jcc.
+ * 
+ * If checked is true, every instruction checks the stack first and stops with an error like the execution loop does.
+ * Division by zero stops with an error, and the smallest value divided by -1 wraps around, just like in the execution loop.
+ * 
+ * @param program The program to compile, it must end with an END instruction.
+ * @param size The number of instructions.
+ * @param strings The string of every CPR operand.
+ * @param stringData The data the strings point into.
+ * @param output The buffered writer that CPK, CPP and CPR print through.
+ * @param random The random number generator of RAN and ROR.
+ * @param checked Whether to emit stack checks.
+ * @return True if the program was compiled, false if it uses something the JIT does not support.
+ */
+bool JitCompiler::compile(const Instruction* program, int size, const StringRef* strings, const char* stringData, OutputBuffer& output, Random& random, bool checked) {
+#ifndef LEMASM_JIT_SUPPORTED
+    return false;
+#else
+    vector<size_t> offsets(size); // The position of every instruction in the code.
+    vector<pair<size_t, int>> jumps; // The displacements to patch, with the index of the instruction they jump to.
+    vector<pair<size_t, pair<int, int>>> errors; // The displacements to patch, with the failing instruction and the error kind.
+    vector<size_t> exits; // The displacements that jump to the epilogue.
+
+    auto checkUnderflow = [&](int index, int values) {
+        if (!checked || values == 0) return;
+        emit({0x49, 0x8D, 0x44, 0x24, (uint8_t) (4 * values)}); // lea rax, [r12 + 4 * values]
+        emit({0x48, 0x39, 0xC3});                                // cmp rbx, rax
+        errors.push_back({emitJump({0x0F, 0x82}), {index, JIT_STACK_UNDERFLOW}}); // jb error
+    };
+    auto checkOverflow = [&](int index) {
+        if (!checked) return;
+        emit({0x48, 0x8D, 0x43, 0x04}); // lea rax, [rbx + 4]
+        emit({0x4C, 0x39, 0xE8});       // cmp rax, r13
+        errors.push_back({emitJump({0x0F, 0x87}), {index, JIT_STACK_OVERFLOW}}); // ja error
+    };
+    auto conditionCode = [](Opcode opcode) -> uint8_t {
+        switch (opcode) {
+            case Opcode::JEQ: case Opcode::JEQI: case Opcode::JEQK: return 0x84; // je
+            case Opcode::JNE: case Opcode::JNEI: case Opcode::JNEK: return 0x85; // jne
+            case Opcode::JGT: case Opcode::JGTI: case Opcode::JGTK: return 0x8F; // jg
+            default: return 0x8C;                                                // jl
+        }
+    };
+
+    code.clear();
+
+    // Prologue: save the callee-saved registers, which also aligns the native stack to 16 bytes for calls.
+    emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}); // push rbx, r12, r13, r14, r15
+    emit({0x49, 0x89, 0xFE});                                     // mov r14, rdi
+    emit({0x4D, 0x8B, 0x26});                                     // mov r12, [r14]
+    emit({0x4D, 0x8B, 0x6E, 0x08});                               // mov r13, [r14 + 8]
+    emit({0x49, 0x8B, 0x5E, 0x10});                               // mov rbx, [r14 + 16]
+
+    for (int i = 0; i < size; i++) {
+        const Instruction& instruction = program[i];
+        offsets[i] = code.size();
+        checkUnderflow(i, stackRequired(instruction));
+
+        switch (instruction.opcode) {
+            case Opcode::ADD:
+                emit({0x8B, 0x43, 0xF8});       // mov eax, [rbx - 8]
+                emit({0x03, 0x43, 0xFC});       // add eax, [rbx - 4]
+                emit({0x89, 0x43, 0xF8});       // mov [rbx - 8], eax
+                emit({0x48, 0x83, 0xEB, 0x04}); // sub rbx, 4
+                break;
+            case Opcode::SUB:
+                emit({0x8B, 0x43, 0xF8});       // mov eax, [rbx - 8]
+                emit({0x2B, 0x43, 0xFC});       // sub eax, [rbx - 4]
+                emit({0x89, 0x43, 0xF8});       // mov [rbx - 8], eax
+                emit({0x48, 0x83, 0xEB, 0x04}); // sub rbx, 4
+                break;
+            case Opcode::MUL:
+                emit({0x8B, 0x43, 0xF8});       // mov eax, [rbx - 8]
+                emit({0x0F, 0xAF, 0x43, 0xFC}); // imul eax, [rbx - 4]
+                emit({0x89, 0x43, 0xF8});       // mov [rbx - 8], eax
+                emit({0x48, 0x83, 0xEB, 0x04}); // sub rbx, 4
+                break;
+            case Opcode::DIV:
+            case Opcode::MOD:
+                emit({0x8B, 0x4B, 0xFC});       // mov ecx, [rbx - 4]
+                emit({0x85, 0xC9});             // test ecx, ecx
+                errors.push_back({emitJump({0x0F, 0x84}), {i, JIT_DIVISION_BY_ZERO}}); // je error
+                emit({0x8B, 0x43, 0xF8});       // mov eax, [rbx - 8]
+                emit({0x83, 0xF9, 0xFF});       // cmp ecx, -1
+                emit({0x75, 0x04});             // jne divide
+                if (instruction.opcode == Opcode::DIV) emit({0xF7, 0xD8}); // neg eax, which wraps the smallest value around to itself
+                else emit({0x31, 0xC0});                                   // xor eax, eax
+                emit({0xEB, (uint8_t) (instruction.opcode == Opcode::DIV ? 0x03 : 0x05)}); // jmp store
+                emit({0x99});                   // divide: cdq
+                emit({0xF7, 0xF9});             // idiv ecx
+                if (instruction.opcode == Opcode::MOD) emit({0x89, 0xD0}); // mov eax, edx
+                emit({0x89, 0x43, 0xF8});       // store: mov [rbx - 8], eax
+                emit({0x48, 0x83, 0xEB, 0x04}); // sub rbx, 4
+                break;
+            case Opcode::CPK:
+                emit({0x48, 0xBF});             // mov rdi, imm64
+                emit64((uint64_t) &output);
+                emit({0x8B, 0x73, 0xFC});       // mov esi, [rbx - 4]
+                emitCall((const void*) jitPrintInt);
+                break;
+            case Opcode::CPP:
+                emit({0x48, 0x83, 0xEB, 0x04}); // sub rbx, 4
+                emit({0x48, 0xBF});             // mov rdi, imm64
+                emit64((uint64_t) &output);
+                emit({0x8B, 0x33});             // mov esi, [rbx]
+                emitCall((const void*) jitPrintInt);
+                break;
+            case Opcode::CPR:
+                emit({0x48, 0xBF});             // mov rdi, imm64
+                emit64((uint64_t) &output);
+                emit({0x48, 0xBE});             // mov rsi, imm64
+                emit64((uint64_t) (stringData + strings[instruction.operand].offset));
+                emit({0xBA});                   // mov edx, imm32
+                emit32(strings[instruction.operand].length);
+                emitCall((const void*) jitPrintString);
+                break;
+            case Opcode::FLS:
+                emit({0x48, 0xBF});             // mov rdi, imm64
+                emit64((uint64_t) &output);
+                emitCall((const void*) jitFlush);
+                break;
+            case Opcode::DUP:
+                checkOverflow(i);
+                emit({0x8B, 0x43, 0xFC});       // mov eax, [rbx - 4]
+                emit({0x89, 0x03});             // mov [rbx], eax
+                emit({0x48, 0x83, 0xC3, 0x04}); // add rbx, 4
+                break;
+            case Opcode::JEQ:
+            case Opcode::JGT:
+            case Opcode::JLT:
+            case Opcode::JNE:
+                emit({0x8B, 0x43, 0xFC});       // mov eax, [rbx - 4]
+                emit({0x8B, 0x4B, 0xF8});       // mov ecx, [rbx - 8]
+                emit({0x48, 0x83, 0xEB, 0x08}); // sub rbx, 8
+                emit({0x39, 0xC1});             // cmp ecx, eax
+                jumps.push_back({emitJump({0x0F, conditionCode(instruction.opcode)}), instruction.target});
+                break;
+            case Opcode::JMP:
+                jumps.push_back({emitJump({0xE9}), instruction.target});
+                break;
+            case Opcode::PSH:
+                checkOverflow(i);
+                emit({0xC7, 0x03});             // mov dword [rbx], imm32
+                emit32(instruction.operand);
+                emit({0x48, 0x83, 0xC3, 0x04}); // add rbx, 4
+                break;
+            case Opcode::POP:
+                emit({0x48, 0x83, 0xEB, 0x04}); // sub rbx, 4
+                break;
+            case Opcode::RAN:
+                checkOverflow(i);
+                emit({0x48, 0xBF});             // mov rdi, imm64
+                emit64((uint64_t) &random);
+                emitCall((const void*) jitRandom);
+                emit({0x89, 0x03});             // mov [rbx], eax
+                emit({0x48, 0x83, 0xC3, 0x04}); // add rbx, 4
+                break;
+            case Opcode::RET:
+                emit({0x31, 0xC0});             // xor eax, eax
+                emit({0x4C, 0x39, 0xE3});       // cmp rbx, r12
+                exits.push_back(emitJump({0x0F, 0x84})); // je epilogue
+                emit({0x8B, 0x43, 0xFC});       // mov eax, [rbx - 4]
+                exits.push_back(emitJump({0xE9}));       // jmp epilogue
+                break;
+            case Opcode::ROR:
+                emit({0x48, 0xBF});             // mov rdi, imm64
+                emit64((uint64_t) &random);
+                emit({0x4C, 0x89, 0xE6});       // mov rsi, r12
+                emit({0x48, 0x89, 0xDA});       // mov rdx, rbx
+                emitCall((const void*) jitShuffle);
+                break;
+            case Opcode::SWP:
+                emit({0x8B, 0x43, 0xFC});       // mov eax, [rbx - 4]
+                emit({0x8B, 0x4B, 0xF8});       // mov ecx, [rbx - 8]
+                emit({0x89, 0x43, 0xF8});       // mov [rbx - 8], eax
+                emit({0x89, 0x4B, 0xFC});       // mov [rbx - 4], ecx
+                break;
+            case Opcode::END:
+                emit({0x31, 0xC0});             // xor eax, eax
+                exits.push_back(emitJump({0xE9}));       // jmp epilogue
+                break;
+            case Opcode::ADDI:
+                emit({0x81, 0x43, 0xFC});       // add dword [rbx - 4], imm32
+                emit32(instruction.operand);
+                break;
+            case Opcode::SUBI:
+                emit({0x81, 0x6B, 0xFC});       // sub dword [rbx - 4], imm32
+                emit32(instruction.operand);
+                break;
+            case Opcode::MULI:
+                emit({0x8B, 0x43, 0xFC});       // mov eax, [rbx - 4]
+                emit({0x69, 0xC0});             // imul eax, eax, imm32
+                emit32(instruction.operand);
+                emit({0x89, 0x43, 0xFC});       // mov [rbx - 4], eax
+                break;
+            case Opcode::JEQI:
+            case Opcode::JGTI:
+            case Opcode::JLTI:
+            case Opcode::JNEI:
+            case Opcode::JEQK:
+            case Opcode::JGTK:
+            case Opcode::JLTK:
+            case Opcode::JNEK:
+                emit({0x8B, 0x4B, 0xFC});       // mov ecx, [rbx - 4]
+                if (stackEffect(instruction.opcode) < 0) emit({0x48, 0x83, 0xEB, 0x04}); // sub rbx, 4
+                emit({0x81, 0xF9});             // cmp ecx, imm32
+                emit32(instruction.operand);
+                jumps.push_back({emitJump({0x0F, conditionCode(instruction.opcode)}), instruction.target});
+                break;
+            default:
+                return false; // This opcode is not supported, the execution loop has to run the program.
+        }
+    }
+
+    // Error stubs: record what went wrong, then return through the epilogue.
+    for (auto& error : errors) {
+        int32_t displacement = code.size() - (error.first + 4);
+        memcpy(&code[error.first], &displacement, 4);
+        emit({0x41, 0xC7, 0x46, 0x18}); // mov dword [r14 + 24], imm32
+        emit32(error.second.first);
+        emit({0x41, 0xC7, 0x46, 0x1C}); // mov dword [r14 + 28], imm32
+        emit32(error.second.second);
+        emit({0x31, 0xC0});             // xor eax, eax
+        exits.push_back(emitJump({0xE9})); // jmp epilogue
+    }
+
+    // Epilogue: write the stack pointer back and restore the callee-saved registers.
+    size_t epilogue = code.size();
+    emit({0x49, 0x89, 0x5E, 0x10});                               // mov [r14 + 16], rbx
+    emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B}); // pop r15, r14, r13, r12, rbx
+    emit({0xC3});                                                 // ret
+
+    for (auto& jump : jumps) {
+        int32_t displacement = offsets[jump.second] - (jump.first + 4);
+        memcpy(&code[jump.first], &displacement, 4);
+    }
+    for (size_t exit : exits) {
+        int32_t displacement = epilogue - (exit + 4);
+        memcpy(&code[exit], &displacement, 4);
+    }
+
+    // Copy the code into its own mapping, which is made executable once it can no longer be written to.
+    bufferSize = code.size();
+    buffer = mmap(nullptr, bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        buffer = nullptr;
+        return false;
+    }
+    memcpy(buffer, code.data(), bufferSize);
+    if (mprotect(buffer, bufferSize, PROT_READ | PROT_EXEC) != 0) return false;
+    code.clear();
+
+    return true;
+#endif
+}
+
+/**
+ * Runs the compiled program.
+ * 
+ * @param context The stack to run on, it also receives the error if the program fails.
+ * @return What RET returns, or 0 if the end of the program is reached or the program fails.
+ */
+int JitCompiler::run(JitContext& context) {
+    context.errorIndex = -1;
+    context.errorKind = 0;
+    return ((int (*)(JitContext*)) buffer)(&context);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BytecodeFile.h"
+#include "Instruction.h"
+#include "OutputBuffer.h"
+#include "Random.h"
+
+using namespace std;
+
+// The JIT emits x86-64 machine code and maps it with mmap, so it is only available on x86-64 Linux.
+#if defined(__x86_64__) && defined(__linux__)
+#define LEMASM_JIT_SUPPORTED
+#endif
+
+/**
+ * The state shared between the interpreter and the compiled code.
+ * The layout is fixed, the compiled code reads and writes these fields by offset.
+ */
+struct JitContext {
+    int* stackBase;  // The bottom of the stack.
+    int* stackLimit; // One past the last slot of the stack.
+    int* sp;         // The stack pointer, it is read on entry and written back on exit.
+    int errorIndex;  // The index of the instruction that failed, or -1 if the program did not fail.
+    int errorKind;   // What went wrong, see the JitError enum.
+};
+
+// The kinds of runtime errors the compiled code can stop with.
+enum JitError {
+    JIT_STACK_UNDERFLOW = 0,
+    JIT_STACK_OVERFLOW = 1,
+    JIT_DIVISION_BY_ZERO = 2
+};
+
+class JitCompiler {
+private:
+    vector<uint8_t> code;
+    void* buffer;
+    size_t bufferSize;
+
+    void emit(initializer_list<uint8_t> bytes);
+    void emit32(int32_t value);
+    void emit64(uint64_t value);
+    size_t emitJump(initializer_list<uint8_t> opcode);
+    void emitCall(const void* function);
+
+public:
+    JitCompiler();
+    ~JitCompiler();
+
+    bool compile(const Instruction* program, int size, const StringRef* strings, const char* stringData, OutputBuffer& output, Random& random, bool checked);
+    int run(JitContext& context);
+};
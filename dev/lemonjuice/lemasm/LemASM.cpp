@@ -1,530 +1,427 @@
 #include <algorithm>
 #include <cctype>
-#include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
-#include <map>
-#include <random>
-#include <stack>
+#include <iostream>
+#include <set>
+#include <sstream>
 #include <string>
-#include <vector>
+#include <thread>
+#include "BatchRunner.h"
+#include "Context.h"
 #include "ErrorHandler.h"
-#include "Line.h"
+#include "Instruction.h"
+#include "LemVM.h"
+#include "ParseCache.h"
+#include "Program.h"
+#include "Snapshot.h"
 
 using namespace std;
 
 // Globals
-bool debugMode = false; // Is debug mode enabled, default is false.
+VMOptions options; // How the program is compiled and run, see VMOptions.
+string bytecodeFileName = ""; // The name of the bytecode file to compile the program to instead of running it, default is "".
+string emitCFileName = ""; // The name of the C file to translate the program to instead of running it, default is "".
 bool outputToFile = false; // Should the output be written to a file, default is false.
 string outputFileName = ""; // The name of the output file, default is "".
-int dataSectionLine = 0; // The line number where the data section starts. Default is 0. If there is no data section, this will remain 0.
-int codeSectionLine = 0; // The line number where the code section starts. Default is 0. If there is no code section, this will remain 0. This should be an error state.
-map<string, int> jumpMap; // A map to store integer values.
-map<string, string> stringMap; // A map to store string values.
-stack<int> lStack; // A stack to store integer values.
-vector<Line> lines; // A vector to store the lines of the file.
+bool cacheStats = false; // Should the statistics of the parse cache be printed, default is false.
+string resumeFileName = ""; // The name of the snapshot file to resume the program from instead of starting it, default is "".
+bool batchMode = false; // Is the input a manifest or directory of programs to run at once, default is false.
+int threadCount = max(1u, thread::hardware_concurrency()); // How many programs run at once in batch mode, default is the number of cores.
 ErrorHandler errorHandler; // An instance of the error handler.
 
 /**
- * Interprets the data section of LemASM code.
- * The data section of the code just contains strings that can be used in the code section, that will be stored in the stringMap.
- * This function loops through the data section and stores the strings in the stringMap.
+ * Parses a positive count given on the command line, such as a stack size.
  * 
- * Here are the relevant mnemonics and symbols that LemASM supports:
- * //  > This symbol is used to comment out a line.
- * STR > This mnemonic is used to define a string in the data section. Example: "STR hello_world = \"Hello, World!\"".
+ * @param text The text to parse, it may only contain digits.
+ * @param value Is set to the count.
+ * @return True if the text is a count from 1 to 999999999, false otherwise.
+ */
+bool parseCount(const string& text, int& value) {
+    if (text.empty() || text.size() > 9 || !all_of(text.begin(), text.end(), [](unsigned char c){return isdigit(c);})) return false;
+    value = stoi(text);
+    return value != 0;
+}
+
+/**
+ * Parses a limit given on the command line, such as a step limit.
  * 
- * These mnemonics must be at the beginning of the line or else the program will error.
- * Since whitespace lines are also legal, we can also skip those.
+ * @param text The text to parse, it may only contain digits.
+ * @param value Is set to the limit.
+ * @return True if the text is a number from 1 to 999999999999999999, false otherwise.
+ */
+bool parseLimit(const string& text, int64_t& value) {
+    if (text.empty() || text.size() > 18 || !all_of(text.begin(), text.end(), [](unsigned char c){return isdigit(c);})) return false;
+    value = stoll(text);
+    return value != 0;
+}
+
+/**
+ * Parses the seed given to --seed.
  * 
- * If the -d flag is set, the function will:
- * 1. Print the line number and the line.
- * 2. Print the stringMap.
+ * @param text The text to parse, it may only contain digits.
+ * @param value Is set to the seed.
+ * @return True if the text is a number from 0 to 18446744073709551615, false otherwise.
+ */
+bool parseSeed(const string& text, uint64_t& value) {
+    if (text.empty() || text.size() > 20 || !all_of(text.begin(), text.end(), [](unsigned char c){return isdigit(c);})) return false;
+    if (text.size() == 20 && text > "18446744073709551615") return false;
+    value = stoull(text);
+    return true;
+}
+
+/**
+ * Parses the opcodes given to --trace-opcodes, separated by commas, such as "ADD,JEQ,ADDI".
  * 
- * @return 0 if the data section was interpreted successfully, 1 otherwise.
- * @author lemonjuice.dev
-*/
-int dataSection() {
-    for (int i = dataSectionLine; i < codeSectionLine - 1; i++) {
-        Line line = lines[i];
-        string contents = line.getContents();
-        if (contents.find("//") == 0) continue;
-        else if (contents.empty() || all_of(contents.begin(),contents.end(),[](unsigned char c){return isspace(c);})) continue;
-        else if (contents.find("STR") == 0) {
-            string str = contents.substr(4);
-            string key = str.substr(0, str.find(" "));
-            string value = str.substr(str.find("\"") + 1);
-            stringMap[key] = value;
-        } else {
-            errorHandler.handleErrorWithLine("Invalid data section line.", line.getLineNumber(), contents);
+ * @param text The text to parse.
+ * @param opcodes Every parsed opcode is added to this set.
+ * @return True if every name is an opcode, false otherwise.
+ */
+bool parseOpcodes(const string& text, set<Opcode>& opcodes) {
+    stringstream stream(text);
+    string name;
+    while (getline(stream, name, ',')) {
+        int opcode = 0;
+        while (opcode < OPCODE_COUNT && name != opcodeName((Opcode) opcode)) opcode++;
+        if (opcode == OPCODE_COUNT) return false;
+        opcodes.insert((Opcode) opcode);
+    }
+    return !opcodes.empty();
+}
+
+/**
+ * Runs every program of a batch on a thread pool, see BatchRunner.
+ * Once every job has finished, the output of every job is printed in the order of the manifest,
+ * followed by a summary of the exit codes (what RET returned) on the error stream, with the errors of every failed job under its file name.
+ * 
+ * @param batchName The name of the manifest or of the directory of programs.
+ * @return 0 if every job ran without errors, 1 otherwise.
+ */
+int runBatch(string batchName) {
+    LemVM vm(options);
+    BatchRunner batch(vm, options.stackSize);
+    int status = filesystem::is_directory(batchName) ? batch.addDirectory(batchName, errorHandler) : batch.addManifest(batchName, errorHandler);
+    if (status != 0) return 1;
+    if (batch.getJobs().empty()) {
+        errorHandler.handleErrorNoLine("No programs found in batch: " + batchName);
+        return 1;
+    }
+
+    ofstream outputFile;
+    if (outputToFile) {
+        outputFile.open(outputFileName, ios::binary);
+        if (!outputFile.is_open()) {
+            errorHandler.handleErrorNoLine("Could not open file: " + outputFileName);
             return 1;
         }
+    }
+    ostream& out = outputToFile ? outputFile : cout;
 
-        if (debugMode) {
-            cout << endl << "Data Section:" << endl;
-            cout << line.getLineNumber() << ": " << contents << endl << endl;
-            cout << "String Map:" << endl;
-            for (auto const& x : stringMap) {
-                cout << x.first << ": " << x.second << endl;
-            }
-        }
+    auto start = chrono::steady_clock::now();
+    batch.run(threadCount);
+    auto milliseconds = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+    int workerCount = min(threadCount, (int) batch.getJobs().size()); // The number of threads the batch ran on.
+    int failedCount = 0;
+    for (const BatchJob& job : batch.getJobs()) {
+        out.write(job.output.data(), job.output.size());
+        if (job.failed) failedCount++;
     }
+    out.flush();
 
-    return 0; // The data was interpreted successfully.
+    cerr << endl << "Batch Results:" << endl;
+    for (const BatchJob& job : batch.getJobs()) {
+        cerr << job.fileName << ": " << (job.failed ? "failed" : "returned " + to_string(job.result)) << endl << job.errors;
+    }
+    cerr << batch.getJobs().size() << " jobs of " << batch.getProgramCount() << " programs, " << failedCount << " failed, "
+         << milliseconds << " ms on " << workerCount << (workerCount == 1 ? " thread." : " threads.") << endl;
+    if (cacheStats) vm.getCache().report(cerr);
+    return failedCount == 0 ? 0 : 1;
 }
 
 /**
- * Interprets the code section of LemASM code.
- * The code section of the code contains the assembly code that will be interpreted and executed.
- * This function loops through the code section and interprets the code line by line.
- * 
- * Here are the relevant mnemonics and symbols that LemASM supports:
- * //  > This symbol is used to comment out a line.
- * .   > This symbol is used to define a label. Example: ".label_name".
- * ADD > This mnemonic adds the top two values of the stack. Example: "ADD".
- * CPK > This mnemonic is used to peek at the top value of the stack and print it to the console. Example: "CPK".
- * CPP > This mnemonic is used to pop a value off the stack and print it to the console. Example: "CPP".
- * CPR > This mnemonic is used to print a string to the console. Example: "CPR hello_world".
- * DIV > This mnemonic divides the top two values of the stack. Example: "DIV".
- * DUP > This mnemonic duplicates the top value of the stack. Example: "DUP".
- * JEQ > This mnemonic jumps to a label if the top two values of the stack are equal. Example: "JEQ label_name".
- * JGT > This mnemonic jumps to a label if the top value of the stack is greater than the second value. Example: "JGT label_name".
- * JLT > This mnemonic jumps to a label if the top value of the stack is less than the second value. Example: "JLT label_name".
- * JMP > This mnemonic jumps to a label. Example: "JMP label_name".
- * JNE > This mnemonic jumps to a label if the top two values of the stack are not equal. Example: "JNE label_name".
- * MOD > This mnemonic takes the modulus of the top two values of the stack. Example: "MOD".
- * MUL > This mnemonic multiplies the top two values of the stack. Example: "MUL".
- * PSH > This mnemonic is used to push a value onto the stack. Example: "PSH 5".
- * POP > This mnemonic is used to pop a value off the stack. Example: "POP".
- * RAN > This mnemonic is used to generate a random number and push it onto the stack. Example: "RAN".
- * RET > This mnemonic is used to return from the program. It returns the top value of the stack. If the stack is empty, it returns 0.
- * ROR > This mnemonic randomizes the order of the stack. Example: "ROR".
- * SUB > This mnemonic subtracts the top two values of the stack. Example: "SUB".
- * SWP > This mnemonic swaps the top two values of the stack. Example: "SWP".
- * 
- * These mnemonics must be at the beginning of the line or else the program will error.
- * Since whitespace lines are also legal, we can also skip those.
+ * Main function for the LemASM (Lemon Assembly) interpreter.
  * 
- * If the -d flag is set, the function will:
- * 1. Print the line number and the line.
- * 2. Print the jumpMap.
+ * This function does a few things:
+ * 1. Check if the user provided an input file.
+ *    - If not, print error and usage information and return 1.
+ * 2. Check that the input file is of the correct format. 
+ *    - Acceptable formats are: lasm, lemasm and lbc (compiled bytecode)
+ *    - If not, print an error message and return 1.
+ *    - With "--batch <manifest|directory>" instead of an input file, every program of the manifest or directory is run at once.
+ * 3. Check if any additional command-line arguments were provided.
+ *    - Acceptable arguments are:
+ *    - Debug                                 > -d 
+ *    - Help                                  > =h
+ *    - Output To File                        > -o <output_file>
+ *    - Execution Engine                      > --dispatch <switch|threaded>
+ *    - Stack Size                            > --stack-size <values> (or --max-stack <values>)
+ *    - Optimization Level                    > -O0, -O1 or -O2
+ *    - Native Code                           > --jit
+ *    - Translate To C                        > --emit-c <output_file>
+ *    - Compile To Bytecode                   > --compile <output_file>
+ *    - Profile                               > --profile
+ *    - Trace                                 > --trace
+ *    - Trace Filters                         > --trace-lines <first>-<last>, --trace-opcodes <opcodes>, --trace-label <label>
+ *    - Trace Sampling                        > --trace-sample <n>
+ *    - Trace Buffer Size                     > --trace-buffer <records>
+ *    - Trace On Error Only                   > --trace-on-error <records>
+ *    - Trace To File                         > --trace-file <output_file>
+ *    - Batch Threads                         > --threads <n>
+ *    - Parse Cache                           > --cache-dir <directory> (or the LEMASM_CACHE_DIR environment variable)
+ *    - Parse Cache Statistics                > --cache-stats
+ *    - Random Seed                           > --seed <n>
+ *    - 64-bit Values                         > --int64
+ *    - Trap Overflow                         > --trap-overflow
+ *    - Step Limit                            > --max-steps <optimized_instructions> (counted after -O1 and -O2 fuse instructions)
+ *    - Timeout                               > --timeout-ms <milliseconds>
+ *    - Statistics                            > --stats
+ *    - Statistics To JSON File               > --stats-json <output_file>
+ *    - Snapshot                              > --snapshot <output_file> (taken on SIGUSR1)
+ *    - Snapshot Interval                     > --snapshot-every <n>
+ *    - Resume From Snapshot                  > --resume <snapshot_file>
+ * 4. Open the output file, if one was provided.
+ * 5. Load the input file with a LemVM, then compile it to bytecode, translate it to C or run it.
+ *    - In batch mode, run the batch instead, see runBatch().
  * 
- * @return 0 if the code section was interpreted successfully, 1 otherwise unless RET is called, in which case it will return what RET returns.
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments. 
+ * @return 0 if the file was interpreted successfully, 1 otherwise.
  * @author lemonjuice.dev
 */
-int codeSection() {
-    for (int i = codeSectionLine; i < lines.size(); i++) {
-        Line line = lines[i];
-        string contents = line.getContents();
-        if (contents.find("//") == 0) continue;
-        else if (contents.empty() || all_of(contents.begin(),contents.end(),[](unsigned char c){return isspace(c);})) continue;
+int main(int argc, char* argv[]) {
+    string usageString = "Usage: LemASM <input_file|--batch <manifest|directory>> [-d] [-p] [-o <output_file>] [--dispatch <switch|threaded>] [--stack-size <values>] [-O0|-O1|-O2] [--jit] [--emit-c <output_file>] [--compile <output_file>] [--profile] [--trace] [--trace-lines <first>-<last>] [--trace-opcodes <opcodes>] [--trace-label <label>] [--trace-sample <n>] [--trace-buffer <records>] [--trace-on-error <records>] [--trace-file <output_file>] [--threads <n>] [--cache-dir <directory>] [--cache-stats] [--seed <n>] [--int64] [--trap-overflow] [--max-steps <optimized_instructions>] [--timeout-ms <milliseconds>] [--max-stack <values>] [--stats] [--stats-json <output_file>] [--snapshot <output_file>] [--snapshot-every <n>] [--resume <snapshot_file>]";
 
-        // If the line contains a label, add it to the jumpMap.
-        else if (contents.find(".") == 0) {
-            string label = contents.substr(1);
-            jumpMap[label] = i;
-        } 
+    // 1. Check if the user provided an input file.
+    if (argc < 2) {
+        errorHandler.handleErrorNoLine("No input file provided.\n" + usageString);
+        return 1;
+    }
 
-        // Mnemonics
-        // Add (ADD)
-        else if (contents.find("ADD") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to add.", line.getLineNumber(), contents);
-                return 1;
-            } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                lStack.push(a + b);
-            }
+    // 2. Check that the input file is of the correct format.
+    string inputFileName = argv[1];
+    int firstArgument = 2; // The index of the first additional argument.
+    if (inputFileName == "--batch") {
+        if (argc < 3) {
+            errorHandler.handleErrorNoLine("No manifest or directory provided.\n" + usageString);
+            return 1;
         }
+        batchMode = true;
+        inputFileName = argv[2];
+        firstArgument = 3;
+    } else {
+        string fileExtension = inputFileName.substr(inputFileName.find_last_of(".") + 1);
+        if (fileExtension != "lasm" && fileExtension != "lemasm" && fileExtension != "lbc") {
+            errorHandler.handleErrorNoLine("Invalid file format.\nAcceptable formats are: \".lasm\", \".lemasm\" or \".lbc\".");
+            return 1;
+        }
+    }
 
-        // Console Peek (CPK)
-        else if (contents.find("CPK") == 0) {
-            if (lStack.empty()) {
-                errorHandler.handleErrorWithLine("Stack is empty.", line.getLineNumber(), contents);
-                return 1;
+    // 3. Check if any additional command-line arguments were provided.
+    options.cacheDirectory = ParseCache::directoryFromEnvironment();
+    for (int i = firstArgument; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "-d") options.debugMode = true;
+        else if (arg == "-h") {
+            string documentationPath = "./documentation/LemASMDocumentation.HTML";
+            system(("start " + documentationPath).c_str());
+            return 0;
+        }
+        else if (arg == "-o") {
+            if (i + 1 < argc) {
+                outputToFile = true;
+                outputFileName = argv[i + 1];
+                i++;
             } else {
-                cout << lStack.top() << endl;
+                errorHandler.handleErrorNoLine("No output file provided.\n" + usageString);
+                return 1;
             }
         }
-
-        // Console Pop (CPP)
-        else if (contents.find("CPP") == 0) {
-            if (lStack.empty()) {
-                errorHandler.handleErrorWithLine("Stack is empty.", line.getLineNumber(), contents);
+        else if (arg == "--dispatch") {
+            string engine = i + 1 < argc ? argv[++i] : "";
+            if (engine == "switch") options.threadedDispatch = false;
+            else if (engine == "threaded") {
+#ifdef LEMASM_THREADED_DISPATCH
+                options.threadedDispatch = true;
+#else
+                errorHandler.handleErrorNoLine("Threaded dispatch is not available in this build.");
                 return 1;
+#endif
             } else {
-                cout << lStack.top() << endl;
-                lStack.pop();
+                errorHandler.handleErrorNoLine("Invalid execution engine: " + engine + "\n" + usageString);
+                return 1;
             }
         }
-
-        // Console Print (CPR)
-        else if (contents.find("CPR") == 0) {
-            string key = contents.substr(4);
-            if (stringMap.find(key) != stringMap.end()) {
-                cout << stringMap[key] << endl;
-            } else {
-                errorHandler.handleErrorWithLine("String not found in string map.", line.getLineNumber(), contents);
+        else if (arg == "--jit") options.jitMode = true;
+        else if (arg == "--profile") {
+            options.profileMode = true;
+            options.profileFileName = inputFileName + ".folded";
+        }
+        else if (arg == "--trace") options.traceMode = true;
+        else if (arg == "--trace-lines") {
+            string range = i + 1 < argc ? argv[++i] : "";
+            size_t dash = range.find('-');
+            string last = dash == string::npos ? range : range.substr(dash + 1);
+            if (!parseCount(range.substr(0, dash), options.traceFilter.firstLine) || !parseCount(last, options.traceFilter.lastLine) || options.traceFilter.firstLine > options.traceFilter.lastLine) {
+                errorHandler.handleErrorNoLine("Invalid line range: " + range + "\n" + usageString);
                 return 1;
             }
+            options.traceMode = true;
         }
-
-        // Divide (DIV)
-        else if (contents.find("DIV") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to divide.", line.getLineNumber(), contents);
+        else if (arg == "--trace-opcodes") {
+            string opcodes = i + 1 < argc ? argv[++i] : "";
+            if (!parseOpcodes(opcodes, options.traceFilter.opcodes)) {
+                errorHandler.handleErrorNoLine("Invalid opcodes: " + opcodes + "\n" + usageString);
                 return 1;
-            } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                lStack.push(b / a);
             }
+            options.traceMode = true;
         }
-
-        // Duplicate (DUP)
-        else if (contents.find("DUP") == 0) {
-            if (lStack.empty()) {
-                errorHandler.handleErrorWithLine("Stack is empty.", line.getLineNumber(), contents);
-                return 1;
+        else if (arg == "--trace-label") {
+            if (i + 1 < argc) {
+                options.traceFilter.label = argv[++i];
+                options.traceMode = true;
             } else {
-                lStack.push(lStack.top());
+                errorHandler.handleErrorNoLine("No label provided.\n" + usageString);
+                return 1;
             }
         }
-
-        // Jump Equal (JEQ)
-        else if (contents.find("JEQ") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to jump.", line.getLineNumber(), contents);
+        else if (arg == "--trace-sample" || arg == "--trace-buffer" || arg == "--trace-on-error") {
+            string count = i + 1 < argc ? argv[++i] : "";
+            int& value = arg == "--trace-sample" ? options.traceSampleRate : arg == "--trace-buffer" ? options.traceCapacity : options.traceErrorCount;
+            if (!parseCount(count, value)) {
+                errorHandler.handleErrorNoLine("Invalid count for " + arg + ": " + count + "\n" + usageString);
                 return 1;
-            } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                if (a == b) {
-                    string label = contents.substr(4);
-                    i = jumpMap[label];
-                }
             }
+            options.traceMode = true;
         }
-
-        // Jump Greater Than (JGT)
-        else if (contents.find("JGT") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to jump.", line.getLineNumber(), contents);
-                return 1;
+        else if (arg == "--trace-file") {
+            if (i + 1 < argc) {
+                options.traceFileName = argv[++i];
+                options.traceMode = true;
             } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                if (b > a) {
-                    string label = contents.substr(4);
-                    i = jumpMap[label];
-                }
+                errorHandler.handleErrorNoLine("No trace output file provided.\n" + usageString);
+                return 1;
             }
         }
-
-        // Jump Less Than (JLT)
-        else if (contents.find("JLT") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to jump.", line.getLineNumber(), contents);
-                return 1;
+        else if (arg == "--compile") {
+            if (i + 1 < argc) {
+                bytecodeFileName = argv[++i];
             } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                if (b < a) {
-                    string label = contents.substr(4);
-                    i = jumpMap[label];
-                }
+                errorHandler.handleErrorNoLine("No bytecode output file provided.\n" + usageString);
+                return 1;
             }
         }
-
-        // Jump (JMP)
-        else if (contents.find("JMP") == 0) {
-            string label = contents.substr(4);
-            i = jumpMap[label];
-        }
-
-        // Jump Not Equal (JNE)
-        else if (contents.find("JNE") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to jump.", line.getLineNumber(), contents);
-                return 1;
+        else if (arg == "--emit-c") {
+            if (i + 1 < argc) {
+                emitCFileName = argv[++i];
             } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                if (a != b) {
-                    string label = contents.substr(4);
-                    i = jumpMap[label];
-                }
+                errorHandler.handleErrorNoLine("No C output file provided.\n" + usageString);
+                return 1;
             }
         }
-
-        // Modulus (MOD)
-        else if (contents.find("MOD") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to take the modulus.", line.getLineNumber(), contents);
+        else if (arg == "-O0" || arg == "-O1" || arg == "-O2") options.optimizationLevel = arg[2] - '0';
+        else if (arg == "--stack-size" || arg == "--max-stack") {
+            string size = i + 1 < argc ? argv[++i] : "";
+            if (!parseCount(size, options.stackSize)) {
+                errorHandler.handleErrorNoLine("Invalid stack size: " + size + "\n" + usageString);
                 return 1;
-            } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                lStack.push(b % a);
             }
         }
-
-        // Multiply (MUL)
-        else if (contents.find("MUL") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to multiply.", line.getLineNumber(), contents);
-                return 1;
+        else if (arg == "--cache-dir") {
+            if (i + 1 < argc) {
+                options.cacheDirectory = argv[++i];
             } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                lStack.push(a * b);
+                errorHandler.handleErrorNoLine("No cache directory provided.\n" + usageString);
+                return 1;
             }
         }
-
-        // Push (PSH)
-        else if (contents.find("PSH") == 0) {
-            int value = stoi(contents.substr(4));
-            lStack.push(value);
-        }
-
-        // Pop (POP)
-        else if (contents.find("POP") == 0) {
-            if (lStack.empty()) {
-                errorHandler.handleErrorWithLine("Stack is empty.", line.getLineNumber(), contents);
+        else if (arg == "--cache-stats") cacheStats = true;
+        else if (arg == "--int64") options.valueBits = 64;
+        else if (arg == "--trap-overflow") options.trapOverflow = true;
+        else if (arg == "--max-steps" || arg == "--timeout-ms") {
+            string limit = i + 1 < argc ? argv[++i] : "";
+            if (!parseLimit(limit, arg == "--max-steps" ? options.maxSteps : options.timeoutMilliseconds)) {
+                errorHandler.handleErrorNoLine("Invalid limit for " + arg + ": " + limit + "\n" + usageString);
                 return 1;
-            } else {
-                lStack.pop();
             }
         }
-
-        // Random (RAN)
-        else if (contents.find("RAN") == 0) {
-            lStack.push(rand());
-        }
-
-        // Return (RET)
-        else if (contents.find("RET") == 0) {
-            if (lStack.empty()) {
-                return 0;
+        else if (arg == "--snapshot" || arg == "--resume") {
+            if (i + 1 < argc) {
+                (arg == "--snapshot" ? options.snapshotFileName : resumeFileName) = argv[++i];
             } else {
-                return lStack.top();
+                errorHandler.handleErrorNoLine("No snapshot file provided.\n" + usageString);
+                return 1;
             }
         }
-
-        // Randomize Order (ROR)
-        else if (contents.find("ROR") == 0) {
-            vector<int> temp;
-            while (!lStack.empty()) {
-                temp.push_back(lStack.top());
-                lStack.pop();
-            }
-
-            // Create a random number generator and shuffle the vector.
-            random_device rd;
-            default_random_engine engine(rd());
-            shuffle(temp.begin(), temp.end(), engine);
-
-            for (int i = 0; i < temp.size(); i++) {
-                lStack.push(temp[i]);
+        else if (arg == "--snapshot-every") {
+            string interval = i + 1 < argc ? argv[++i] : "";
+            if (!parseLimit(interval, options.snapshotInterval)) {
+                errorHandler.handleErrorNoLine("Invalid snapshot interval: " + interval + "\n" + usageString);
+                return 1;
             }
         }
-
-        // Subtract (SUB)
-        else if (contents.find("SUB") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to subtract.", line.getLineNumber(), contents);
-                return 1;
+        else if (arg == "--stats") options.statsMode = true;
+        else if (arg == "--stats-json") {
+            if (i + 1 < argc) {
+                options.statsFileName = argv[++i];
+                options.statsMode = true;
             } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                lStack.push(b - a);
+                errorHandler.handleErrorNoLine("No statistics output file provided.\n" + usageString);
+                return 1;
             }
         }
-
-        // Swap (SWP)
-        else if (contents.find("SWP") == 0) {
-            if (lStack.size() < 2) {
-                errorHandler.handleErrorWithLine("Stack does not have enough values to swap.", line.getLineNumber(), contents);
+        else if (arg == "--seed") {
+            string seed = i + 1 < argc ? argv[++i] : "";
+            if (!parseSeed(seed, options.seed)) {
+                errorHandler.handleErrorNoLine("Invalid seed: " + seed + "\n" + usageString);
                 return 1;
-            } else {
-                int a = lStack.top();
-                lStack.pop();
-                int b = lStack.top();
-                lStack.pop();
-                lStack.push(a);
-                lStack.push(b);
             }
+            options.seeded = true;
         }
-
-        // After all the mnemonics are checked, check for errors.
-        else {
-            errorHandler.handleErrorWithLine("Invalid code section line.", line.getLineNumber(), contents);
-            return 1;
-        }
-
-        if (debugMode) {
-            cout << endl << "Code Section:" << endl;
-            cout << line.getLineNumber() << ": " << contents << endl << endl;
-            cout << "Jump Map:" << endl;
-            for (auto const& x : jumpMap) {
-                cout << x.first << ": " << x.second << endl;
+        else if (arg == "--threads") {
+            string count = i + 1 < argc ? argv[++i] : "";
+            if (!parseCount(count, threadCount)) {
+                errorHandler.handleErrorNoLine("Invalid thread count: " + count + "\n" + usageString);
+                return 1;
             }
+        } else {
+            errorHandler.handleErrorNoLine("Invalid argument: " + arg + "\n" + usageString);
+            return 1;
         }
-
     }
 
-    return 0; // The code was interpreted successfully.
-}
-
-/**
- * Interprets the given LemASM file.
- * 
- * This function reads the file line by line and interprets each line.
- * The file is split into two sections: the data section and the code section.
- * The data section (the top half of the file) defines strings that can be used in output.
- * - The strings in this section are stored in a map.
- * The code section (the bottom half of the file) contains the actual assembly code.
- * - The code in this section is interpreted and executed line by line.
- * 
- * The main data structure of the LemASM interpreter is a stack, which is used to store integer values.
- * There are two supplementary maps, one that stores string values and another that stores integer values.
- * There is also a vector that stores the lines of the file.
- * 
- * To accomplish this, the interpreter splits the will read each section of the file seperately.
- * 
- * Here are the relevant mnemonics and symbols that LemASM supports:
- * - #   > This symbol is used to define a section of the file. Uses include: "#DATA" and "#CODE".
- * 
- * @param fileName The name of the file to interpret.
- * @return 0 if the file was interpreted successfully, 1 otherwise.
- * @author lemonjuice.dev
- */
-int interpretFile(string fileName) {
-    // Open the file
-    ifstream file(fileName);
-    if (!file.is_open()) {
-        errorHandler.handleErrorNoLine("Could not open file: " + fileName);
+    // Debugging, profiling, tracing, statistics and translating print per program, which does not work for programs that run at once.
+    // Snapshots are written by a forked child, which a process that runs programs on several threads must not do, see Snapshot::canFork().
+    if (options.snapshotInterval > 0 && options.snapshotFileName.empty()) options.snapshotFileName = inputFileName + ".snapshot";
+    bool snapshots = !options.snapshotFileName.empty() || !resumeFileName.empty();
+    if (batchMode && (options.debugMode || options.profileMode || options.traceMode || options.statsMode || snapshots || !bytecodeFileName.empty() || !emitCFileName.empty())) {
+        errorHandler.handleErrorNoLine("-d, --profile, --trace, --stats, --snapshot, --resume, --compile and --emit-c can not be used with --batch.");
         return 1;
     }
-
-    // Read the file line by line
-    string line; // The current line being read
-    int lineNumber = 0; // The current line number
-
-    /* First we need to determine if the line is a comment or empty.
-     * If it is a comment or empty, we can skip it.
-     *  If it is not a comment or empty, we can check if it is a section.
-     * If it is a section, we can determine if it is the data section or the code section.
-     *  If it is the data section, we can add the string to the string map.
-     *      If the program has a data section, it must come before the code section.
-     *  If it is the code section, we can interpret the line.
-     *      Once the program enters the code section, it will run until it reaches the return statement.
-     * 
-     * For now, we will just read the file and place the lines into a vector.
-     * Additionally, we can store the line numbers where the sections start.
-     * If the -d flag is set, we will print the line number and the line as well.
-     */
-    while (getline(file, line)) {
-        lineNumber++;
-        lines.push_back(Line(lineNumber, line));
-        if(line == "#DATA") dataSectionLine = lineNumber;
-        else if(line == "#CODE") codeSectionLine = lineNumber;
-        
-        if (debugMode) cout << lineNumber << ": " << line << endl;
-    }
-
-    // Close the file as it is no longer needed
-    file.close();
-
-    // Interpret the data section
-    int dataSectionSuccessful = dataSection();
-
-    // Interpret the code section
-    int codeSectionSuccessful;
-    if (dataSectionSuccessful == 0) codeSectionSuccessful = codeSection();
-    return codeSectionSuccessful;
-}
-
-/**
- * Main function for the LemASM (Lemon Assembly) interpreter.
- * 
- * This function does a few things:
- * 1. Check if the user provided an input file.
- *    - If not, print error and usage information and return 1.
- * 2. Check that the input file is of the correct format. 
- *    - Acceptable formats are: lasm and lemasm
- *    - If not, print an error message and return 1.
- * 3. Check if any additional command-line arguments were provided.
- *    - Acceptable arguments are:
- *    - Debug                                 > -d 
- *    - Help                                  > =h
- *    - Output To File                        > -o <output_file>
- * 4. Pass the input file to the LemASM interpreter.
- * 
- * @param argc The number of command-line arguments.
- * @param argv The command-line arguments. 
- * @return 0 if the file was interpreted successfully, 1 otherwise.
- * @author lemonjuice.dev
-*/
-int main(int argc, char* argv[]) {
-    string usageString = "Usage: LemASM <input_file> [-d] [-p] [-o <output_file>]";
-
-    // 1. Check if the user provided an input file.
-    if (argc < 2) {
-        errorHandler.handleErrorNoLine("No input file provided.\n" + usageString);
-        return 1;
-    }
-
-    // 2. Check that the input file is of the correct format.
-    string inputFileName = argv[1];
-    string fileExtension = inputFileName.substr(inputFileName.find_last_of(".") + 1);
-    if (fileExtension != "lasm" && fileExtension != "lemasm") {
-        errorHandler.handleErrorNoLine("Invalid file format.\nAcceptable formats are: \".lasm\" or \".lemasm\".");
+    if (!options.snapshotFileName.empty()) Snapshot::handleSignal();
+    if (batchMode) return runBatch(inputFileName);
+
+    // 4. Send the output of the program to the output file if one was provided.
+    Context context(options.stackSize);
+    // A resumed run continues the output file where the snapshot left it, see LemVM::resume().
+    if (outputToFile && !context.getOutput().open(outputFileName, resumeFileName.empty())) {
+        errorHandler.handleErrorNoLine("Could not open file: " + outputFileName);
         return 1;
     }
 
-    // 3. Check if any additional command-line arguments were provided.
-    for (int i = 2; i < argc; i++) {
-        string arg = argv[i];
-        if (arg == "-d") debugMode = true;
-        else if (arg == "-h") {
-            string documentationPath = "./documentation/LemASMDocumentation.HTML";
-            system(("start " + documentationPath).c_str());
-            return 0;
-        }
-        else if (arg == "-o") {
-            if (i + 1 < argc) {
-                outputToFile = true;
-                outputFileName = argv[i + 1];
-                i++;
-            } else {
-                errorHandler.handleErrorNoLine("No output file provided.\n" + usageString);
-                return 1;
-            }
-        } else {
-            errorHandler.handleErrorNoLine("Invalid argument: " + arg + "\n" + usageString);
-            return 1;
-        }
-    }
-
-    // 4. Pass the input file to the LemASM interpreter.
-    return interpretFile(inputFileName);
+    // 5. Load the input file, then compile it to bytecode, translate it to C or run it.
+    // Translating needs the source of the program, so it never goes through the parse cache.
+    if (!bytecodeFileName.empty() || !emitCFileName.empty()) options.cacheDirectory = "";
+    LemVM vm(options);
+    Program program;
+    auto parseStart = chrono::steady_clock::now();
+    if (vm.load(inputFileName, program) != 0) return 1;
+    context.getStatistics().setParseTime(chrono::duration<double, milli>(chrono::steady_clock::now() - parseStart).count());
+    if (!bytecodeFileName.empty()) return vm.writeBytecode(program, bytecodeFileName);
+    if (!emitCFileName.empty()) return vm.emitC(program, emitCFileName, options.stackSize);
+    int result = resumeFileName.empty() ? vm.run(program, context) : vm.resume(program, context, resumeFileName);
+    if (cacheStats) vm.getCache().report(cerr);
+    return result;
 }
\ No newline at end of file
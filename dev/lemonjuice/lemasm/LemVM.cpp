@@ -0,0 +1,1535 @@
+#include "LemVM.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "BulkKernels.h"
+#include "BytecodeFile.h"
+#include "CEmitter.h"
+#include "JitCompiler.h"
+#include "Optimizer.h"
+#include "StackVerifier.h"
+
+using namespace std;
+
+// How many steps a run with a timeout executes between two reads of the clock.
+const int64_t TIMEOUT_CHECK_INTERVAL = 1 << 16;
+
+// A map from each code section mnemonic to the opcode it compiles to.
+const map<string, Opcode, less<>> mnemonicMap = {
+    {"ADD", Opcode::ADD}, {"CPK", Opcode::CPK}, {"CPP", Opcode::CPP}, {"CPR", Opcode::CPR},
+    {"DIV", Opcode::DIV}, {"DUP", Opcode::DUP}, {"FLS", Opcode::FLS}, {"JEQ", Opcode::JEQ},
+    {"JGT", Opcode::JGT}, {"JLT", Opcode::JLT}, {"JMP", Opcode::JMP}, {"JNE", Opcode::JNE},
+    {"MOD", Opcode::MOD}, {"MUL", Opcode::MUL}, {"PSH", Opcode::PSH}, {"POP", Opcode::POP},
+    {"RAN", Opcode::RAN}, {"RET", Opcode::RET}, {"ROR", Opcode::ROR}, {"SUB", Opcode::SUB},
+    {"SWP", Opcode::SWP}, {"SUM", Opcode::SUM}, {"PRD", Opcode::PRD}, {"MIN", Opcode::MIN},
+    {"MAX", Opcode::MAX}, {"FIL", Opcode::FIL}, {"SEQ", Opcode::SEQ}, {"REV", Opcode::REV}
+};
+
+/**
+ * Gets the operand of a line, which is everything after its mnemonic and the space that follows it.
+ * 
+ * @param contents The line.
+ * @return The operand, or "" if the line has no operand.
+ */
+static string_view operandOf(string_view contents) {
+    return contents.size() > 4 ? contents.substr(4) : string_view();
+}
+
+/**
+ * Parses the literal of a PSH line.
+ * Like stoi, leading whitespace and a sign are allowed and everything after the last digit is ignored.
+ * 
+ * @param text The operand of the line.
+ * @param valueBits The width of the values of the program, 32 or 64.
+ * @param value Is set to the literal.
+ * @param errorMessage Is set to what is wrong with the literal, if anything.
+ * @return True if the literal was parsed, false otherwise.
+ */
+static bool parseLiteral(string_view text, int valueBits, int64_t& value, string& errorMessage) {
+    string literal(text);
+    char* end;
+    errno = 0;
+    long long parsed = strtoll(literal.c_str(), &end, 10);
+    if (end == literal.c_str()) {
+        errorMessage = "Invalid number.";
+        return false;
+    }
+    if (errno == ERANGE || (valueBits == 32 && (parsed < INT_MIN || parsed > INT_MAX))) {
+        errorMessage = "Number is out of range, values are " + to_string(valueBits) + " bits wide.";
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+// Constructor
+LemVM::LemVM(VMOptions options): options(options), cache(options.cacheDirectory) {}
+
+/**
+ * Interprets the data section of LemASM code.
+ * The data section of the code just contains strings that can be used in the code section.
+ * This function reads the data section from the line reader and interns every string into the stringArena, and its name into the stringMap,
+ * it stops at the line before the code section so that compileCodeSection() can carry on with the same reader.
+ * 
+ * Here are the relevant mnemonics and symbols that LemASM supports:
+ * //  > This symbol is used to comment out a line.
+ * STR > This mnemonic is used to define a string in the data section. Example: "STR hello_world = \"Hello, World!\"".
+ * 
+ * These mnemonics must be at the beginning of the line or else the program will error.
+ * Since whitespace lines are also legal, we can also skip those.
+ * A string that is defined twice keeps its last value.
+ * 
+ * If debug mode is on, the function will:
+ * 1. Print the line number and the line of every string.
+ * 2. Print the stringMap once the whole data section has been read.
+ * 
+ * @param program The program being compiled.
+ * @param reader The reader of the source file, it is left at the line before the code section.
+ * @return 0 if the data section was interpreted successfully, 1 otherwise.
+ * @author lemonjuice.dev
+*/
+int LemVM::dataSection(Program& program, LineReader& reader) {
+    if (options.debugMode) cout << endl << "Data Section:" << endl;
+    string_view contents;
+    while (reader.getLineIndex() < program.codeSectionLine - 1 && reader.next(contents)) {
+        int lineNumber = reader.getLineIndex();
+        if (lineNumber <= program.dataSectionLine) continue; // The lines before the data section are ignored.
+        if (contents.compare(0, 2, "//") == 0) continue;
+        else if (contents.empty() || all_of(contents.begin(),contents.end(),[](unsigned char c){return isspace(c);})) continue;
+        else if (contents.compare(0, 3, "STR") == 0) {
+            string_view str = operandOf(contents);
+            string_view key = str.substr(0, str.find(" "));
+            string_view value = str.substr(str.find("\"") + 1);
+            StringRef stringRef = {(uint32_t) program.stringArena.size(), (uint32_t) value.size()};
+            program.stringArena.append(value);
+
+            auto entry = program.stringMap.find(key);
+            if (entry != program.stringMap.end()) {
+                program.stringRefs[entry->second] = stringRef;
+            } else {
+                program.stringMap.emplace(key, program.stringRefs.size());
+                program.stringRefs.push_back(stringRef);
+            }
+        } else {
+            errorHandler.handleErrorWithLine("Invalid data section line.", lineNumber, string(contents));
+            return 1;
+        }
+
+        if (options.debugMode) cout << lineNumber << ": " << contents << endl;
+    }
+
+    if (options.debugMode) {
+        cout << endl << "String Map:" << endl;
+        for (auto const& x : program.stringMap) {
+            const StringRef& stringRef = program.stringRefs[x.second];
+            cout << x.first << ": " << string_view(program.stringArena.data() + stringRef.offset, stringRef.length) << endl;
+        }
+    }
+
+    return 0; // The data was interpreted successfully.
+}
+
+/**
+ * Compiles the code section of LemASM code into the program vector.
+ * The code section of the code contains the assembly code that will be interpreted and executed.
+ * This function reads the rest of the source file once and decodes every line into a fixed-size instruction,
+ * so that the execution loop never has to look at the text of a line again.
+ * Only where each line starts in the file is kept, the lines are copied into the program once the whole code section is read (see Program).
+ * 
+ * Here are the relevant mnemonics and symbols that LemASM supports:
+ * //  > This symbol is used to comment out a line.
+ * .   > This symbol is used to define a label. Example: ".label_name".
+ * ADD > This mnemonic adds the top two values of the stack. Example: "ADD".
+ * CPK > This mnemonic is used to peek at the top value of the stack and print it to the console. Example: "CPK".
+ * CPP > This mnemonic is used to pop a value off the stack and print it to the console. Example: "CPP".
+ * CPR > This mnemonic is used to print a string to the console. Example: "CPR hello_world".
+ * DIV > This mnemonic divides the top two values of the stack. Example: "DIV".
+ * DUP > This mnemonic duplicates the top value of the stack. Example: "DUP".
+ * FLS > This mnemonic writes out everything printed so far, output is otherwise buffered until the program ends. Example: "FLS".
+ * JEQ > This mnemonic jumps to a label if the top two values of the stack are equal. Example: "JEQ label_name".
+ * JGT > This mnemonic jumps to a label if the top value of the stack is greater than the second value. Example: "JGT label_name".
+ * JLT > This mnemonic jumps to a label if the top value of the stack is less than the second value. Example: "JLT label_name".
+ * JMP > This mnemonic jumps to a label. Example: "JMP label_name".
+ * JNE > This mnemonic jumps to a label if the top two values of the stack are not equal. Example: "JNE label_name".
+ * MOD > This mnemonic takes the modulus of the top two values of the stack. Example: "MOD".
+ * MUL > This mnemonic multiplies the top two values of the stack. Example: "MUL".
+ * PSH > This mnemonic is used to push a value onto the stack. Example: "PSH 5".
+ * POP > This mnemonic is used to pop a value off the stack. Example: "POP".
+ * RAN > This mnemonic is used to generate a random number and push it onto the stack. Example: "RAN".
+ * RET > This mnemonic is used to return from the program. It returns the top value of the stack. If the stack is empty, it returns 0.
+ * ROR > This mnemonic randomizes the order of the stack. Example: "ROR".
+ * SUB > This mnemonic subtracts the top two values of the stack. Example: "SUB".
+ * SWP > This mnemonic swaps the top two values of the stack. Example: "SWP".
+ * SUM > This mnemonic replaces the top n values of the stack with their sum. Example: "SUM 100".
+ * PRD > This mnemonic replaces the top n values of the stack with their product. Example: "PRD 10".
+ * MIN > This mnemonic replaces the top n values of the stack with the smallest of them. Example: "MIN 100".
+ * MAX > This mnemonic replaces the top n values of the stack with the largest of them. Example: "MAX 100".
+ * FIL > This mnemonic pops a value off the stack and pushes it n times. Example: "FIL 100".
+ * SEQ > This mnemonic pops a value off the stack and pushes n values counting up from it. Example: "SEQ 100".
+ * REV > This mnemonic reverses the order of the top n values of the stack. Example: "REV 100".
+ * 
+ * These mnemonics must be at the beginning of the line or else the program will error.
+ * Since whitespace lines are also legal, we can also skip those.
+ * Comments, whitespace lines and labels do not produce an instruction.
+ * 
+ * Every PSH literal must fit in the value width of the program, a literal that only fits in 64 bits becomes a PSHW.
+ * The count of a bulk mnemonic (SUM, PRD, MIN, MAX, FIL, SEQ and REV) must be a number from 1 to 2147483647.
+ * Every CPR is resolved to the index of its string here, printing a string that is not in the data section is an error of the code section.
+ * Every label is stored in the jumpMap as the index of the instruction that follows it.
+ * A jump to a label that is not defined yet is patched once the whole code section has been read,
+ * so forward jumps are resolved as well as backward jumps without reading the file twice.
+ * A label may only be defined once, defining the same label twice is an error, and it is reported before any other error of the code section.
+ * 
+ * @param program The program being compiled.
+ * @param reader The reader of the source file, it is read to the end.
+ * @return 0 if the code section was compiled successfully, 1 otherwise.
+ * @author lemonjuice.dev
+*/
+int LemVM::compileCodeSection(Program& program, LineReader& reader) {
+    vector<pair<int, string>> forwardJumps; // The index of every jump to a label that was not defined yet, and that label.
+    int errorLine = -1; // The line number of the first invalid line, it is reported once the labels are known to be unique.
+    string errorContents; // The contents of the first invalid line.
+    string errorMessage; // What is wrong with the first invalid line.
+
+    string_view contents;
+    while (reader.next(contents)) {
+        int lineNumber = reader.getLineIndex();
+        if (lineNumber <= program.codeSectionLine) continue; // The lines before the code section are not code.
+        if (contents.compare(0, 2, "//") == 0) continue;
+        else if (contents.empty() || all_of(contents.begin(),contents.end(),[](unsigned char c){return isspace(c);})) continue;
+
+        // Labels
+        if (contents.compare(0, 1, ".") == 0) {
+            string label(contents.substr(1));
+            if (program.jumpMap.find(label) != program.jumpMap.end()) {
+                errorHandler.handleErrorWithLine("Label is already defined.", lineNumber, string(contents));
+                return 1;
+            }
+            program.jumpMap[label] = program.instructions.size();
+            continue;
+        }
+        if (errorLine != -1) continue; // After an invalid line only the labels are still checked.
+
+        // Mnemonics
+        auto mnemonic = mnemonicMap.find(contents.substr(0, 3));
+        if (mnemonic == mnemonicMap.end()) {
+            errorLine = lineNumber;
+            errorContents = string(contents);
+            errorMessage = "Invalid code section line.";
+            continue;
+        }
+
+        Instruction instruction = {mnemonic->second, 0, 0, (int) program.lineRefs.size()};
+        program.lineRefs.push_back({lineNumber, (uint32_t) reader.getOffset(contents), (uint32_t) contents.size()});
+        switch (instruction.opcode) {
+            case Opcode::PSH: {
+                int64_t value;
+                if (!parseLiteral(operandOf(contents), program.valueBits, value, errorMessage)) {
+                    errorLine = lineNumber;
+                    errorContents = string(contents);
+                } else if (value < INT_MIN || value > INT_MAX) {
+                    instruction.opcode = Opcode::PSHW;
+                    instruction.operand = program.constantPool.size();
+                    program.constantPool.push_back(value);
+                } else {
+                    instruction.operand = (int) value;
+                }
+                break;
+            }
+            case Opcode::SUM:
+            case Opcode::PRD:
+            case Opcode::MIN:
+            case Opcode::MAX:
+            case Opcode::FIL:
+            case Opcode::SEQ:
+            case Opcode::REV: {
+                int64_t count;
+                if (!parseLiteral(operandOf(contents), 32, count, errorMessage) || count < 1) {
+                    errorLine = lineNumber;
+                    errorContents = string(contents);
+                    errorMessage = "Invalid count, it must be a number from 1 to " + to_string(INT_MAX) + ".";
+                } else {
+                    instruction.operand = (int) count;
+                }
+                break;
+            }
+            case Opcode::CPR: {
+                auto entry = program.stringMap.find(operandOf(contents));
+                if (entry != program.stringMap.end()) {
+                    instruction.operand = entry->second;
+                } else {
+                    errorLine = lineNumber;
+                    errorContents = string(contents);
+                    errorMessage = "String not found in string map.";
+                }
+                break;
+            }
+            case Opcode::JEQ:
+            case Opcode::JGT:
+            case Opcode::JLT:
+            case Opcode::JMP:
+            case Opcode::JNE: {
+                string label(operandOf(contents));
+                auto target = program.jumpMap.find(label);
+                if (target != program.jumpMap.end()) instruction.target = target->second;
+                else forwardJumps.push_back({(int) program.instructions.size(), label});
+                break;
+            }
+            default:
+                break;
+        }
+        program.instructions.push_back(instruction);
+    }
+
+    // Patch the forward jumps, the first jump whose label does not exist is reported unless an invalid line comes first.
+    for (auto const& jump : forwardJumps) {
+        Instruction& instruction = program.instructions[jump.first];
+        auto target = program.jumpMap.find(jump.second);
+        if (target == program.jumpMap.end()) {
+            const LineRef& line = program.lineRefs[instruction.lineIndex];
+            if (errorLine != -1 && errorLine < line.lineNumber) break;
+            errorHandler.handleErrorWithLine("Label not found in jump map.", line.lineNumber,
+                                             string(program.source.getData() + line.offset, line.length));
+            return 1;
+        }
+        instruction.target = target->second;
+    }
+    if (errorLine != -1) {
+        errorHandler.handleErrorWithLine(errorMessage, errorLine, errorContents);
+        return 1;
+    }
+
+    // The program always ends with an END instruction, so the execution loop never has to check for the end of the program.
+    program.instructions.push_back({Opcode::END, 0, 0, -1});
+
+    return 0; // The code was compiled successfully.
+}
+
+/**
+ * Reports a runtime error for the given instruction, using the line it was compiled from.
+ * 
+ * @param program The program that is running.
+ * @param context The context of the run, it is marked as failed.
+ * @param errorMessage The error message to display.
+ * @param instruction The instruction the error occurred on.
+ * @return 1, so that the execution loop can return the result directly.
+ */
+int LemVM::runtimeError(const Program& program, Context& context, string errorMessage, const Instruction& instruction) {
+    context.failed = true;
+    context.output.flush();
+    Line line = program.lineAt(instruction.lineIndex);
+    errorHandler.handleErrorWithLine(errorMessage, line.getLineNumber(), line.getContents());
+    return 1;
+}
+
+/**
+ * Reports a stack overflow for the given instruction.
+ * 
+ * @param program The program that is running.
+ * @param context The context of the run.
+ * @param instruction The instruction that tried to push onto the full stack.
+ * @return 1, so that the execution loop can return the result directly.
+ */
+int LemVM::stackOverflowError(const Program& program, Context& context, const Instruction& instruction) {
+    return runtimeError(program, context, "Stack overflow, the stack can hold at most " + to_string(context.stackSize) + " values.", instruction);
+}
+
+/**
+ * Reports an arithmetic overflow for the given instruction, when overflow trapping is on.
+ * 
+ * @param program The program that is running.
+ * @param context The context of the run.
+ * @param instruction The instruction whose result does not fit.
+ * @return 1, so that the execution loop can return the result directly.
+ */
+int LemVM::overflowError(const Program& program, Context& context, const Instruction& instruction) {
+    return runtimeError(program, context, "Integer overflow, the result does not fit in " + to_string(program.valueBits) + " bits.", instruction);
+}
+
+/**
+ * Prints the debug information for an executed instruction, which is the line it was compiled from.
+ * A program compiled in debug mode is not optimized, but a bytecode file may hold superinstructions, they are printed with their opcode
+ * since they stand for the lines after their own as well.
+ * 
+ * @param program The program that is running.
+ * @param context The context of the run.
+ * @param instruction The instruction that was executed.
+ */
+void LemVM::printDebugInfo(const Program& program, Context& context, const Instruction& instruction) {
+    context.output.flush();
+    Line line = program.lineAt(instruction.lineIndex);
+    cout << line.getLineNumber() << ": " << line.getContents();
+    if (instruction.opcode > Opcode::END && instruction.opcode != Opcode::PSHW) cout << " (" << opcodeName(instruction.opcode) << ")";
+    cout << endl;
+}
+
+/**
+ * Tells the profiler, the tracer and the statistics that an instruction starts executing.
+ * This is only called by the instrumented execution loop, see executeProgram().
+ * 
+ * @param context The context of the run.
+ * @param pc The index of the instruction.
+ * @param opcode The opcode of the instruction.
+ * @param depth The depth of the stack.
+ * @param top The top value of the stack, or 0 if the stack is empty.
+ */
+inline void LemVM::instrument(Context& context, int pc, Opcode opcode, int depth, int64_t top) {
+    if (options.profileMode) context.profiler.enter(pc);
+    if (options.traceMode) context.tracer.record(pc, opcode, top, depth);
+    if (options.statsMode) context.statistics.enter(opcode, depth);
+}
+
+/**
+ * Tells the statistics that a jump was taken, only conditional jumps count as taken branches.
+ * This is only called by the instrumented execution loop, see executeProgram().
+ * 
+ * @param context The context of the run.
+ * @param opcode The opcode of the jump.
+ */
+inline void LemVM::instrumentJump(Context& context, Opcode opcode) {
+    if (options.statsMode && isConditionalJump(opcode)) context.statistics.takeBranch();
+}
+
+/**
+ * Gets the step count at which a limited run checks its limits next.
+ * Without a timeout that is the first step past the step limit, with a timeout the clock is read every TIMEOUT_CHECK_INTERVAL steps.
+ * With snapshots it is also the step count of the next snapshot, and SIGUSR1 is checked for every TIMEOUT_CHECK_INTERVAL steps.
+ * 
+ * @param context The context of the run.
+ * @param steps The number of steps executed so far.
+ * @return The step count of the next check.
+ */
+int64_t LemVM::nextCheckpoint(const Context& context, int64_t steps) {
+    int64_t checkpoint = options.maxSteps > 0 ? options.maxSteps + 1 : INT64_MAX;
+    if (options.timeoutMilliseconds > 0 || !options.snapshotFileName.empty()) checkpoint = min(checkpoint, steps + TIMEOUT_CHECK_INTERVAL);
+    if (!options.snapshotFileName.empty()) checkpoint = min(checkpoint, context.nextSnapshot);
+    return checkpoint;
+}
+
+/**
+ * Checks the step limit and the timeout of a limited run, once it has reached its checkpoint, then takes a snapshot if one is due.
+ * The error reports the instruction the run was stopped at, how many steps it executed and how deep its stack was.
+ * 
+ * @param program The program that is running.
+ * @param context The context of the run.
+ * @param instruction The jump the run was stopped at.
+ * @param target The index of the instruction the jump goes to, a snapshot resumes there.
+ * @param stack The bottom of the stack.
+ * @param depth The depth of the stack.
+ * @param steps The number of steps executed so far.
+ * @param checkpoint Is set to the step count of the next check.
+ * @param deadline When the timeout runs out.
+ * @return 1 if a limit was exceeded, 0 otherwise.
+ */
+template <typename Value>
+int LemVM::checkLimits(const Program& program, Context& context, const Instruction& instruction, int target, const Value* stack, int64_t depth,
+                       int64_t steps, int64_t& checkpoint, chrono::steady_clock::time_point deadline) {
+    string state = " after " + to_string(steps) + " steps, at a stack depth of " + to_string(depth) + ".";
+    if (options.maxSteps > 0 && steps > options.maxSteps) {
+        return runtimeError(program, context, "Step limit of " + to_string(options.maxSteps) + " exceeded" + state, instruction);
+    }
+    if (options.timeoutMilliseconds > 0 && chrono::steady_clock::now() >= deadline) {
+        return runtimeError(program, context, "Timeout of " + to_string(options.timeoutMilliseconds) + " ms exceeded" + state, instruction);
+    }
+    if (!options.snapshotFileName.empty() && (steps >= context.nextSnapshot || Snapshot::takeRequest())) {
+        saveSnapshot(program, context, target, stack, depth, steps);
+    }
+    checkpoint = nextCheckpoint(context, steps);
+    return 0;
+}
+
+/**
+ * Takes a snapshot of a run that is about to jump, see Snapshot.
+ * The output is flushed first, so that the output position of the snapshot is what has actually been written.
+ * The process then forks and the child writes the snapshot while the run goes on, the pages of the stack are only copied once either of them changes.
+ * Only one child writes at a time, so a run that snapshots faster than the disk can keep up waits for the last snapshot first.
+ * If the process has other threads, like an embedder that runs programs on several threads, or it can not fork,
+ * the snapshot is written before the run goes on, see Snapshot::canFork().
+ * 
+ * @param program The program that is running.
+ * @param context The context of the run.
+ * @param pc The index of the instruction the run continues at.
+ * @param stack The bottom of the stack.
+ * @param depth The depth of the stack.
+ * @param steps The number of steps executed so far.
+ */
+template <typename Value>
+void LemVM::saveSnapshot(const Program& program, Context& context, int pc, const Value* stack, int64_t depth, int64_t steps) {
+    context.output.flush();
+    waitForSnapshot(context);
+    context.nextSnapshot = options.snapshotInterval > 0 ? steps + options.snapshotInterval : INT64_MAX;
+
+    SnapshotHeader header = {{'L', 'S', 'S', '\0'}, SNAPSHOT_VERSION, 0, Snapshot::fingerprint(program.code, program.codeSize, program.constants, program.valueBits),
+                             (uint32_t) program.valueBits, pc, steps, context.output.getBytesWritten(), {}, (uint64_t) depth};
+    context.random.getState(header.random);
+
+    pid_t child = Snapshot::canFork() ? fork() : -1;
+    if (child == 0) {
+        int status = Snapshot::write(options.snapshotFileName, header, (const char*) stack, depth * sizeof(Value));
+        if (status != 0) errorHandler.handleErrorNoLine("Could not write file: " + options.snapshotFileName);
+        _exit(status);
+    }
+    if (child > 0) context.snapshotWriter = child;
+    else if (Snapshot::write(options.snapshotFileName, header, (const char*) stack, depth * sizeof(Value)) != 0) {
+        errorHandler.handleErrorNoLine("Could not write file: " + options.snapshotFileName);
+    }
+}
+
+/**
+ * Waits until the child process that writes the last snapshot has finished, so that the snapshot is complete.
+ * 
+ * @param context The context of the run.
+ */
+void LemVM::waitForSnapshot(Context& context) {
+    if (context.snapshotWriter == -1) return;
+    waitpid(context.snapshotWriter, nullptr, 0);
+    context.snapshotWriter = -1;
+}
+
+/**
+ * Applies ADD, SUB or MUL to the second value of the stack and the top value of the stack.
+ * Without Trapping the result wraps around like it does on two's complement hardware, instead of being undefined,
+ * with Trapping the overflow is detected with the checked arithmetic builtins of the compiler.
+ * 
+ * @param opcode ADD, SUB or MUL, it is always a constant so the other cases are compiled away.
+ * @param b The second value of the stack.
+ * @param a The top value of the stack.
+ * @param result Is set to the result.
+ * @return False if Trapping is set and the result does not fit in a Value, true otherwise.
+ */
+template <bool Trapping, typename Value>
+static inline bool arithmetic(Opcode opcode, Value b, Value a, Value& result) {
+    typedef make_unsigned_t<Value> Unsigned;
+    if constexpr (Trapping) {
+        if (opcode == Opcode::ADD) return !__builtin_add_overflow(b, a, &result);
+        if (opcode == Opcode::SUB) return !__builtin_sub_overflow(b, a, &result);
+        return !__builtin_mul_overflow(b, a, &result);
+    } else {
+        if (opcode == Opcode::ADD) result = (Value) ((Unsigned) b + (Unsigned) a);
+        else if (opcode == Opcode::SUB) result = (Value) ((Unsigned) b - (Unsigned) a);
+        else result = (Value) ((Unsigned) b * (Unsigned) a);
+        return true;
+    }
+}
+
+/*
+ * The dispatch macros shared by both execution engines.
+ * CASE   > Starts the handler of an opcode, it is both a switch case and, for threaded dispatch, a goto label.
+ *          When instrumented, it also tells the profiler, the tracer and the statistics which instruction starts executing.
+ * NEXT   > Finishes a handler and moves on to the following instruction.
+ * JUMP   > Finishes a handler and moves on to the instruction at the given index.
+ *          When limited, it also counts the instructions of the straight run that just ended, checks the limits and takes due snapshots.
+ *          When instrumented, it also tells the statistics that the branch was taken.
+ * 
+ * The switch engine goes back to the single switch at the top of the loop after every instruction.
+ * The threaded engine jumps straight from the end of one handler to the start of the next one,
+ * so every handler gets its own indirect branch for the branch predictor to learn.
+ */
+#ifdef LEMASM_THREADED_DISPATCH
+#define CASE(name) case Opcode::name: op_##name: if constexpr (Instrumented) instrument(context, instruction - code, Opcode::name, sp - stackBase, sp == stackBase ? 0 : sp[-1]);
+#define DISPATCH() if constexpr (Threaded) goto *dispatchTable[(int) instruction->opcode]; else continue
+#else
+#define CASE(name) case Opcode::name: if constexpr (Instrumented) instrument(context, instruction - code, Opcode::name, sp - stackBase, sp == stackBase ? 0 : sp[-1]);
+#define DISPATCH() continue
+#endif
+#define NEXT() if (debugMode) printDebugInfo(program, context, *instruction); instruction++; DISPATCH()
+#define JUMP(target) if (debugMode) printDebugInfo(program, context, *instruction); \
+    if constexpr (Instrumented) instrumentJump(context, instruction->opcode); \
+    if constexpr (Limited) { \
+        steps += instruction - blockStart + 1; \
+        blockStart = code + (target); \
+        if (steps >= checkpoint && checkLimits(program, context, *instruction, target, stackBase, sp - stackBase, steps, checkpoint, deadline) != 0) return 1; \
+    } \
+    instruction = code + (target); DISPATCH()
+
+/**
+ * Executes the compiled code section of LemASM code.
+ * This function executes the program instruction by instruction, until RET is called or the end of the program is reached.
+ * See compileCodeSection() for what each mnemonic does.
+ * 
+ * There are two execution engines, chosen by the Threaded template parameter:
+ * - The switch engine (Threaded = false) is portable and works with every compiler.
+ * - The threaded engine (Threaded = true) uses computed gotos (labels as values), which are only available on GCC and Clang.
+ *   It is only compiled in if LEMASM_THREADED_DISPATCH is defined, see the Makefile.
+ * 
+ * The Checked template parameter decides whether the stack is checked for underflow and overflow on every instruction.
+ * It can only be false if the StackVerifier has proven that the program never underflows or overflows the stack.
+ * 
+ * The Instrumented template parameter decides whether every executed instruction is passed to the profiler, the tracer and the statistics,
+ * see VMOptions::profileMode, VMOptions::traceMode and VMOptions::statsMode.
+ * 
+ * The Value template parameter is the type of the values on the stack, int for 32-bit programs and int64_t for 64-bit programs.
+ * The Trapping template parameter decides whether arithmetic that overflows stops with an error instead of wrapping around,
+ * see VMOptions::trapOverflow. Division by zero is always an error.
+ * The Limited template parameter decides whether the step limit and the timeout are enforced and snapshots are taken,
+ * see VMOptions::maxSteps and VMOptions::snapshotFileName.
+ * Steps are only counted when a jump is taken, by how far the program got since the last taken jump,
+ * so a limited run pays for a subtraction and a comparison per taken jump instead of a counter per instruction.
+ * A run can only go over its step limit by a single straight run of instructions, as every loop takes a jump.
+ * Every combination is its own instantiation, so no engine pays for a check it does not need.
+ * 
+ * If debug mode is on, the function will print the line number and the line of every executed instruction.
+ * 
+ * @param program The program to execute.
+ * @param context The context to execute the program in.
+ * @return 0 if the code section was interpreted successfully, 1 otherwise unless RET is called, in which case it will return what RET returns.
+ * @author lemonjuice.dev
+*/
+template <typename Value, bool Trapping, bool Threaded, bool Checked, bool Instrumented, bool Limited>
+int LemVM::executeProgram(const Program& program, Context& context) {
+#ifdef LEMASM_THREADED_DISPATCH
+    // This table must be in the same order as the Opcode enum.
+    static void* const dispatchTable[] = {
+        &&op_ADD, &&op_CPK, &&op_CPP, &&op_CPR, &&op_DIV, &&op_DUP, &&op_FLS, &&op_JEQ, &&op_JGT, &&op_JLT, &&op_JMP, &&op_JNE,
+        &&op_MOD, &&op_MUL, &&op_PSH, &&op_POP, &&op_RAN, &&op_RET, &&op_ROR, &&op_SUB, &&op_SWP,
+        &&op_SUM, &&op_PRD, &&op_MIN, &&op_MAX, &&op_FIL, &&op_SEQ, &&op_REV, &&op_END,
+        &&op_ADDI, &&op_SUBI, &&op_MULI, &&op_JEQI, &&op_JGTI, &&op_JLTI, &&op_JNEI, &&op_JEQK, &&op_JGTK, &&op_JLTK, &&op_JNEK,
+        &&op_PSHW
+    };
+#endif
+
+    typedef make_unsigned_t<Value> Unsigned;
+    const Instruction* const code = program.code; // The instructions of the program.
+    const int64_t* const constants = program.constants; // The literal of every PSHW operand.
+    const StringRef* const strings = program.strings; // The string of every CPR operand.
+    const char* const stringData = program.stringData; // The data the strings point into.
+    const bool debugMode = options.debugMode; // Is debug mode enabled.
+    OutputBuffer& output = context.output; // The buffered writer the program prints through.
+    Random& random = context.random; // The random number generator of RAN and ROR.
+
+    const Instruction* instruction = code + context.resumePc; // The next instruction to execute, the first one unless the run resumes a snapshot.
+    Value* stackBase; // The bottom of the stack.
+    if constexpr (is_same_v<Value, int>) stackBase = context.stack.get();
+    else stackBase = context.getWideStack();
+    Value* const stackLimit = stackBase + context.stackSize; // One past the last slot of the stack.
+    Value* sp = stackBase + context.resumeDepth; // The stack pointer, one past the top value of the stack.
+
+    int64_t steps = context.resumeSteps; // The number of instructions executed before blockStart, only counted when Limited.
+    const Instruction* blockStart = instruction; // The first instruction of the straight run that is executing.
+    int64_t checkpoint = 0; // The step count at which the limits are checked next.
+    chrono::steady_clock::time_point deadline; // When the timeout runs out.
+    if constexpr (Limited) {
+        context.nextSnapshot = options.snapshotInterval > 0 ? steps + options.snapshotInterval : INT64_MAX;
+        checkpoint = nextCheckpoint(context, steps);
+        deadline = chrono::steady_clock::now() + chrono::milliseconds(options.timeoutMilliseconds);
+    }
+
+    while (true) {
+        switch (instruction->opcode) {
+            // Add (ADD)
+            CASE(ADD) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to add.", *instruction);
+                if (!arithmetic<Trapping>(Opcode::ADD, sp[-2], sp[-1], sp[-2])) return overflowError(program, context, *instruction);
+                sp--;
+                NEXT();
+            }
+
+            // Console Peek (CPK)
+            CASE(CPK) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                output.writeLine(sp[-1]);
+                NEXT();
+            }
+
+            // Console Pop (CPP)
+            CASE(CPP) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                output.writeLine(*--sp);
+                NEXT();
+            }
+
+            // Console Print (CPR)
+            CASE(CPR) {
+                const StringRef& entry = strings[instruction->operand];
+                output.writeLine(stringData + entry.offset, entry.length);
+                NEXT();
+            }
+
+            // Divide (DIV)
+            CASE(DIV) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to divide.", *instruction);
+                Value a = sp[-1];
+                Value b = sp[-2];
+                if (a == 0) return runtimeError(program, context, "Division by zero.", *instruction);
+                if (a == -1) {
+                    // The smallest value divided by -1 is the only division that overflows, it wraps around to itself.
+                    if (Trapping && b == numeric_limits<Value>::min()) return overflowError(program, context, *instruction);
+                    sp[-2] = (Value) ((Unsigned) 0 - (Unsigned) b);
+                } else {
+                    sp[-2] = b / a;
+                }
+                sp--;
+                NEXT();
+            }
+
+            // Duplicate (DUP)
+            CASE(DUP) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                if (Checked && sp == stackLimit) return stackOverflowError(program, context, *instruction);
+                *sp = sp[-1];
+                sp++;
+                NEXT();
+            }
+
+            // Flush (FLS)
+            CASE(FLS) {
+                output.flush();
+                NEXT();
+            }
+
+            // Jump Equal (JEQ)
+            CASE(JEQ) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to jump.", *instruction);
+                Value a = sp[-1];
+                Value b = sp[-2];
+                sp -= 2;
+                if (a == b) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // Jump Greater Than (JGT)
+            CASE(JGT) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to jump.", *instruction);
+                Value a = sp[-1];
+                Value b = sp[-2];
+                sp -= 2;
+                if (b > a) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // Jump Less Than (JLT)
+            CASE(JLT) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to jump.", *instruction);
+                Value a = sp[-1];
+                Value b = sp[-2];
+                sp -= 2;
+                if (b < a) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // Jump (JMP)
+            CASE(JMP) {
+                JUMP(instruction->target);
+            }
+
+            // Jump Not Equal (JNE)
+            CASE(JNE) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to jump.", *instruction);
+                Value a = sp[-1];
+                Value b = sp[-2];
+                sp -= 2;
+                if (a != b) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // Modulus (MOD)
+            CASE(MOD) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to take the modulus.", *instruction);
+                Value a = sp[-1];
+                Value b = sp[-2];
+                if (a == 0) return runtimeError(program, context, "Division by zero.", *instruction);
+                sp[-2] = a == -1 ? 0 : b % a; // The hardware traps on the smallest value modulo -1, even though the result is 0.
+                sp--;
+                NEXT();
+            }
+
+            // Multiply (MUL)
+            CASE(MUL) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to multiply.", *instruction);
+                if (!arithmetic<Trapping>(Opcode::MUL, sp[-2], sp[-1], sp[-2])) return overflowError(program, context, *instruction);
+                sp--;
+                NEXT();
+            }
+
+            // Push (PSH)
+            CASE(PSH) {
+                if (Checked && sp == stackLimit) return stackOverflowError(program, context, *instruction);
+                *sp++ = instruction->operand;
+                NEXT();
+            }
+
+            // Pop (POP)
+            CASE(POP) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                sp--;
+                NEXT();
+            }
+
+            // Random (RAN)
+            CASE(RAN) {
+                if (Checked && sp == stackLimit) return stackOverflowError(program, context, *instruction);
+                *sp++ = random.nextInt();
+                NEXT();
+            }
+
+            // Return (RET)
+            CASE(RET) {
+                context.depth = sp - stackBase;
+                if (sp == stackBase) return 0;
+                return (int) sp[-1];
+            }
+
+            // Randomize Order (ROR)
+            CASE(ROR) {
+                random.shuffle(stackBase, sp);
+                NEXT();
+            }
+
+            // Subtract (SUB)
+            CASE(SUB) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to subtract.", *instruction);
+                if (!arithmetic<Trapping>(Opcode::SUB, sp[-2], sp[-1], sp[-2])) return overflowError(program, context, *instruction);
+                sp--;
+                NEXT();
+            }
+
+            // Swap (SWP)
+            CASE(SWP) {
+                if (Checked && sp - stackBase < 2) return runtimeError(program, context, "Stack does not have enough values to swap.", *instruction);
+                swap(sp[-1], sp[-2]);
+                NEXT();
+            }
+
+            // Bulk opcodes, they run on the kernels of BulkKernels.cpp.
+            // Sum (SUM), with Trapping it overflows exactly when n - 1 ADDs would.
+            CASE(SUM) {
+                int count = instruction->operand;
+                if (Checked && sp - stackBase < count) return runtimeError(program, context, "Stack does not have enough values to sum.", *instruction);
+                Value sum;
+                if constexpr (Trapping) {
+                    sum = sp[-1];
+                    for (int i = 2; i <= count; i++) {
+                        if (!arithmetic<true>(Opcode::ADD, sp[-i], sum, sum)) return overflowError(program, context, *instruction);
+                    }
+                } else {
+                    sum = sumValues(sp - count, count);
+                }
+                sp -= count - 1;
+                sp[-1] = sum;
+                NEXT();
+            }
+
+            // Product (PRD), with Trapping it overflows exactly when n - 1 MULs would.
+            CASE(PRD) {
+                int count = instruction->operand;
+                if (Checked && sp - stackBase < count) return runtimeError(program, context, "Stack does not have enough values to multiply.", *instruction);
+                Value product;
+                if constexpr (Trapping) {
+                    product = sp[-1];
+                    for (int i = 2; i <= count; i++) {
+                        if (!arithmetic<true>(Opcode::MUL, sp[-i], product, product)) return overflowError(program, context, *instruction);
+                    }
+                } else {
+                    product = productValues(sp - count, count);
+                }
+                sp -= count - 1;
+                sp[-1] = product;
+                NEXT();
+            }
+
+            // Minimum (MIN)
+            CASE(MIN) {
+                int count = instruction->operand;
+                if (Checked && sp - stackBase < count) return runtimeError(program, context, "Stack does not have enough values to compare.", *instruction);
+                Value minimum = minimumValue(sp - count, count);
+                sp -= count - 1;
+                sp[-1] = minimum;
+                NEXT();
+            }
+
+            // Maximum (MAX)
+            CASE(MAX) {
+                int count = instruction->operand;
+                if (Checked && sp - stackBase < count) return runtimeError(program, context, "Stack does not have enough values to compare.", *instruction);
+                Value maximum = maximumValue(sp - count, count);
+                sp -= count - 1;
+                sp[-1] = maximum;
+                NEXT();
+            }
+
+            // Fill (FIL)
+            CASE(FIL) {
+                int count = instruction->operand;
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                if (Checked && stackLimit - sp < count - 1) return stackOverflowError(program, context, *instruction);
+                fillValues(sp - 1, count, sp[-1]);
+                sp += count - 1;
+                NEXT();
+            }
+
+            // Sequence (SEQ), with Trapping the last value must fit as well.
+            CASE(SEQ) {
+                int count = instruction->operand;
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                if (Checked && stackLimit - sp < count - 1) return stackOverflowError(program, context, *instruction);
+                Value last;
+                if (!arithmetic<Trapping>(Opcode::ADD, sp[-1], (Value) (count - 1), last)) return overflowError(program, context, *instruction);
+                sequenceValues(sp - 1, count, sp[-1]);
+                sp += count - 1;
+                NEXT();
+            }
+
+            // Reverse (REV)
+            CASE(REV) {
+                int count = instruction->operand;
+                if (Checked && sp - stackBase < count) return runtimeError(program, context, "Stack does not have enough values to reverse.", *instruction);
+                reverseValues(sp - count, count);
+                NEXT();
+            }
+
+            // End of the program, the code was interpreted successfully.
+            CASE(END) {
+                context.depth = sp - stackBase;
+                return 0;
+            }
+
+            // Superinstructions, see Optimizer.cpp.
+            // PSH n, ADD (ADDI)
+            CASE(ADDI) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack does not have enough values to add.", *instruction);
+                if (!arithmetic<Trapping>(Opcode::ADD, sp[-1], (Value) instruction->operand, sp[-1])) return overflowError(program, context, *instruction);
+                NEXT();
+            }
+
+            // PSH n, SUB (SUBI)
+            CASE(SUBI) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack does not have enough values to subtract.", *instruction);
+                if (!arithmetic<Trapping>(Opcode::SUB, sp[-1], (Value) instruction->operand, sp[-1])) return overflowError(program, context, *instruction);
+                NEXT();
+            }
+
+            // PSH n, MUL (MULI)
+            CASE(MULI) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack does not have enough values to multiply.", *instruction);
+                if (!arithmetic<Trapping>(Opcode::MUL, sp[-1], (Value) instruction->operand, sp[-1])) return overflowError(program, context, *instruction);
+                NEXT();
+            }
+
+            // PSH n, JEQ (JEQI)
+            CASE(JEQI) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack does not have enough values to jump.", *instruction);
+                if (*--sp == instruction->operand) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // PSH n, JGT (JGTI)
+            CASE(JGTI) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack does not have enough values to jump.", *instruction);
+                if (*--sp > instruction->operand) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // PSH n, JLT (JLTI)
+            CASE(JLTI) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack does not have enough values to jump.", *instruction);
+                if (*--sp < instruction->operand) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // PSH n, JNE (JNEI)
+            CASE(JNEI) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack does not have enough values to jump.", *instruction);
+                if (*--sp != instruction->operand) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // DUP, PSH n, JEQ (JEQK)
+            CASE(JEQK) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                if (sp[-1] == instruction->operand) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // DUP, PSH n, JGT (JGTK)
+            CASE(JGTK) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                if (sp[-1] > instruction->operand) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // DUP, PSH n, JLT (JLTK)
+            CASE(JLTK) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                if (sp[-1] < instruction->operand) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // DUP, PSH n, JNE (JNEK)
+            CASE(JNEK) {
+                if (Checked && sp == stackBase) return runtimeError(program, context, "Stack is empty.", *instruction);
+                if (sp[-1] != instruction->operand) { JUMP(instruction->target); }
+                NEXT();
+            }
+
+            // Push Wide (PSHW), a PSH whose literal only fits in 64 bits.
+            CASE(PSHW) {
+                if (Checked && sp == stackLimit) return stackOverflowError(program, context, *instruction);
+                *sp++ = (Value) constants[instruction->operand];
+                NEXT();
+            }
+        }
+    }
+}
+
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+
+/**
+ * Runs a program with the execution engine chosen by the options, for the given value type and overflow trapping, see executeProgram().
+ * 
+ * @param program The program to run.
+ * @param context The context to run the program in.
+ * @return What the execution loop returns.
+ */
+template <typename Value, bool Trapping>
+int LemVM::runEngine(const Program& program, Context& context) {
+    bool instrumented = options.profileMode || options.traceMode || options.statsMode;
+    // A resumed run starts in the middle of the program, which the StackVerifier did not prove anything about.
+    bool verified = program.isVerified(context.stackSize) && !context.resuming;
+    bool limited = options.maxSteps > 0 || options.timeoutMilliseconds > 0 || !options.snapshotFileName.empty();
+    // The instrumented engine always enforces the limits, its checkpoint is never reached if there are none.
+#ifdef LEMASM_THREADED_DISPATCH
+    if (options.threadedDispatch && instrumented) return executeProgram<Value, Trapping, true, true, true, true>(program, context);
+    if (options.threadedDispatch && limited) {
+        return verified ? executeProgram<Value, Trapping, true, false, false, true>(program, context) : executeProgram<Value, Trapping, true, true, false, true>(program, context);
+    }
+    if (options.threadedDispatch) {
+        return verified ? executeProgram<Value, Trapping, true, false, false, false>(program, context) : executeProgram<Value, Trapping, true, true, false, false>(program, context);
+    }
+#endif
+    if (instrumented) return executeProgram<Value, Trapping, false, true, true, true>(program, context);
+    if (limited) {
+        return verified ? executeProgram<Value, Trapping, false, false, false, true>(program, context) : executeProgram<Value, Trapping, false, true, false, true>(program, context);
+    }
+    return verified ? executeProgram<Value, Trapping, false, false, false, false>(program, context) : executeProgram<Value, Trapping, false, true, false, false>(program, context);
+}
+
+/**
+ * Compiles the program to native code with the JitCompiler and runs it.
+ * Runtime errors of the native code are reported the same way the execution loop reports them.
+ * The JIT only supports 32-bit programs that run from the start without overflow trapping, a step limit, a timeout or snapshots.
+ * 
+ * @param program The program to run.
+ * @param context The context to run the program in.
+ * @param result Is set to what the program returns.
+ * @return True if the program was run, false if the JIT does not support it, in which case nothing was run.
+ */
+bool LemVM::runJit(const Program& program, Context& context, int& result) {
+    if (program.valueBits != 32 || options.trapOverflow || options.maxSteps > 0 || options.timeoutMilliseconds > 0) return false;
+    if (!options.snapshotFileName.empty() || context.resuming) return false;
+    JitCompiler jit;
+    bool checked = !program.isVerified(context.stackSize);
+    if (!jit.compile(program.code, program.codeSize, program.strings, program.stringData, context.output, context.random, checked)) return false;
+
+    int* stack = context.stack.get();
+    JitContext jitContext = {stack, stack + context.stackSize, stack, -1, 0};
+    result = jit.run(jitContext);
+    if (jitContext.errorIndex == -1) {
+        context.depth = jitContext.sp - stack;
+    } else {
+        const Instruction& instruction = program.code[jitContext.errorIndex];
+        if (jitContext.errorKind == JIT_STACK_OVERFLOW) result = stackOverflowError(program, context, instruction);
+        else if (jitContext.errorKind == JIT_DIVISION_BY_ZERO) result = runtimeError(program, context, "Division by zero.", instruction);
+        else result = runtimeError(program, context, StackVerifier::underflowMessage(instruction.opcode), instruction);
+    }
+    return true;
+}
+
+/**
+ * Prints the report of the profiler and writes its folded stacks, once a profiled program has returned.
+ * The report goes to the error stream, so it is never mixed up with the output of the program.
+ * 
+ * @param program The program that was run.
+ * @param context The context it was run in.
+ */
+void LemVM::reportProfile(const Program& program, Context& context) {
+    context.profiler.finish();
+
+    vector<Line> instructionLines; // The source line of every instruction.
+    for (int i = 0; i < program.codeSize; i++) {
+        if (program.code[i].lineIndex == -1) instructionLines.push_back(Line(0, "(end of program)"));
+        else instructionLines.push_back(program.lineAt(program.code[i].lineIndex));
+    }
+
+    context.profiler.report(cerr, program.code, program.codeSize, instructionLines, program.jumpMap);
+    if (!context.profiler.writeFolded(options.profileFileName, program.codeSize, instructionLines, program.jumpMap)) {
+        errorHandler.handleErrorNoLine("Could not write file: " + options.profileFileName);
+    }
+}
+
+/**
+ * Prints the statistics of a run as a table, or writes them as JSON if a statistics file is set, once the program has returned.
+ * The table goes to the error stream, so it is never mixed up with the output of the program.
+ * 
+ * @param context The context the program was run in.
+ */
+void LemVM::reportStatistics(Context& context) {
+    if (options.statsFileName.empty()) context.statistics.report(cerr);
+    else if (!context.statistics.writeJson(options.statsFileName)) errorHandler.handleErrorNoLine("Could not write file: " + options.statsFileName);
+}
+
+/**
+ * Starts the tracer of the context with the trace filter of the options.
+ * 
+ * @param program The program that is about to run.
+ * @param context The context it runs in.
+ * @return 0 if the tracer was started, 1 if the label of the trace filter does not exist.
+ */
+int LemVM::startTrace(const Program& program, Context& context) {
+    vector<int> lineNumbers; // The source line number of every instruction.
+    for (int i = 0; i < program.codeSize; i++) {
+        lineNumbers.push_back(program.code[i].lineIndex == -1 ? 0 : program.lineAt(program.code[i].lineIndex).getLineNumber());
+    }
+
+    if (!context.tracer.start(program.code, program.codeSize, lineNumbers, program.jumpMap, options.traceFilter, options.traceCapacity, options.traceSampleRate)) {
+        errorHandler.handleErrorNoLine("Label not found in jump map: " + options.traceFilter.label);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Prints the trace once the program has returned.
+ * If traceErrorCount is set, only the last few records are printed, and only if the program failed.
+ * 
+ * @param context The context the program was run in.
+ */
+void LemVM::reportTrace(Context& context) {
+    if (options.traceErrorCount > 0 && !context.failed) return;
+    size_t count = options.traceErrorCount > 0 ? options.traceErrorCount : options.traceCapacity;
+
+    if (options.traceFileName.empty()) {
+        context.tracer.dump(cerr, count);
+        return;
+    }
+    ofstream file(options.traceFileName);
+    if (!file.is_open()) {
+        errorHandler.handleErrorNoLine("Could not open file: " + options.traceFileName);
+        return;
+    }
+    context.tracer.dump(file, count);
+}
+
+/**
+ * Runs a program in the given context, with the execution engine chosen by the options.
+ * Every run starts with an empty stack, so the same program and context can be run any number of times, unless it resumes a snapshot, see resume().
+ * If seeded is set, every run also starts from the same seed, so it draws the same random numbers.
+ * Programs that passed stack verification are executed without stack checks.
+ * If jitMode is set, the program is compiled to native code instead, unless debug mode, profiling, tracing or statistics are on or the JIT does not support it.
+ * If profileMode, traceMode or statsMode is set, the program is executed with stack checks by the instrumented execution loop.
+ * A 64-bit program runs on a 64-bit stack, what RET returns is cut down to its low 32 bits.
+ * Everything the program printed is flushed once it returns, and the run waits for the last snapshot to be written, see saveSnapshot().
+ * 
+ * If debug mode is on, the jumpMap is printed before the program starts.
+ * 
+ * @param program The program to run, it must have been loaded successfully.
+ * @param context The context to run the program in.
+ * @return 0 if the code section was interpreted successfully, 1 otherwise unless RET is called, in which case it will return what RET returns.
+ * @author lemonjuice.dev
+*/
+int LemVM::run(const Program& program, Context& context) {
+    context.failed = false;
+    context.depth = 0;
+    context.valueBits = program.valueBits;
+    if (options.seeded && !context.resuming) context.random.seed(options.seed);
+
+    if (options.debugMode) {
+        cout << endl << "Jump Map:" << endl;
+        for (auto const& x : program.jumpMap) {
+            cout << x.first << ": " << x.second << endl;
+        }
+        cout << endl << "Code Section:" << endl;
+    }
+
+    bool instrumented = options.profileMode || options.traceMode || options.statsMode;
+    if (options.profileMode) context.profiler.start(program.codeSize);
+    if (options.traceMode && startTrace(program, context) != 0) return 1;
+    if (options.statsMode) context.statistics.start();
+
+    uint64_t printed = context.output.getBytesWritten(); // What earlier runs in the context printed.
+    auto start = chrono::steady_clock::now();
+    int result;
+    if (options.jitMode && !options.debugMode && !instrumented && runJit(program, context, result)) {}
+    else if (program.valueBits == 64) result = options.trapOverflow ? runEngine<int64_t, true>(program, context) : runEngine<int64_t, false>(program, context);
+    else result = options.trapOverflow ? runEngine<int, true>(program, context) : runEngine<int, false>(program, context);
+    context.output.flush();
+    waitForSnapshot(context);
+    context.resuming = false;
+    context.resumePc = 0;
+    context.resumeDepth = 0;
+    context.resumeSteps = 0;
+
+    if (options.profileMode) reportProfile(program, context);
+    if (options.traceMode) reportTrace(context);
+    if (options.statsMode) {
+        double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        context.statistics.finish(milliseconds, context.output.getBytesWritten() - printed, result, context.failed);
+        reportStatistics(context);
+    }
+    return result;
+}
+
+/**
+ * Resumes a run from a snapshot, it continues where the run the snapshot was taken of was stopped, see Snapshot.
+ * The stack, the random number generator, the step count and the output position are restored, then the program runs like it does in run().
+ * The program must be the same as the one the snapshot was taken of, loaded with the same optimization level and value width.
+ * If the output goes to a file, the file is cut off at the output position, so that nothing printed after the snapshot is printed twice.
+ * A resumed run always checks the stack, and a step limit counts the steps executed before the snapshot as well.
+ * 
+ * @param program The program to run, it must have been loaded successfully.
+ * @param context The context to run the program in.
+ * @param snapshotFileName The name of the snapshot file.
+ * @return 1 if the snapshot can not be resumed, otherwise what run() returns.
+ */
+int LemVM::resume(const Program& program, Context& context, string snapshotFileName) {
+    Snapshot snapshot;
+    if (snapshot.load(snapshotFileName, errorHandler) != 0) return 1;
+    const SnapshotHeader& header = snapshot.getHeader();
+
+    if (header.valueBits != (uint32_t) program.valueBits
+        || header.fingerprint != Snapshot::fingerprint(program.code, program.codeSize, program.constants, program.valueBits)) {
+        errorHandler.handleErrorNoLine("The snapshot was taken of another program, or with another optimization level or value width: " + snapshotFileName);
+        return 1;
+    }
+    if (header.pc < 0 || header.pc >= program.codeSize) {
+        errorHandler.handleErrorNoLine("Corrupt snapshot file: " + snapshotFileName);
+        return 1;
+    }
+    if (header.depth > (uint64_t) context.stackSize) {
+        errorHandler.handleErrorNoLine("The snapshot has " + to_string(header.depth) + " values on the stack, but the stack can only hold "
+                                       + to_string(context.stackSize) + ".");
+        return 1;
+    }
+    if (!context.output.seek(header.outputPosition)) {
+        errorHandler.handleErrorNoLine("The output file is shorter than when the snapshot was taken: " + snapshotFileName);
+        return 1;
+    }
+
+    size_t size = header.depth * (header.valueBits / 8);
+    if (program.valueBits == 64) memcpy(context.getWideStack(), snapshot.getStack(), size);
+    else memcpy(context.stack.get(), snapshot.getStack(), size);
+    context.random.setState(header.random);
+    context.resuming = true;
+    context.resumePc = header.pc;
+    context.resumeDepth = header.depth;
+    context.resumeSteps = header.steps;
+    return run(program, context);
+}
+
+/**
+ * Compiles the given LemASM file into a program.
+ * 
+ * This function maps the file into memory and interprets each line in place, the lines are never copied out of the file.
+ * The file is split into two sections: the data section and the code section.
+ * The data section (the top half of the file) defines strings that can be used in output.
+ * - The strings in this section are interned into a single arena, and their names are stored in a map.
+ * The code section (the bottom half of the file) contains the actual assembly code.
+ * - The code in this section is compiled into a vector of instructions, which can then be run, see run().
+ * 
+ * There are two supplementary maps, one that stores string values and another that stores integer values.
+ * There is also a vector that stores every line an instruction was compiled from, and a vector that stores the compiled instructions.
+ * All of them live in the program, so compiling a file never changes the LemVM.
+ * 
+ * To accomplish this, the interpreter splits the will read each section of the file seperately.
+ * 
+ * Here are the relevant mnemonics and symbols that LemASM supports:
+ * - #   > This symbol is used to define a section of the file. Uses include: "#DATA" and "#CODE".
+ * 
+ * @param fileName The name of the file to compile.
+ * @param program The program to compile into, it must not have been loaded yet.
+ * @return 0 if the file was compiled successfully, 1 otherwise.
+ * @author lemonjuice.dev
+ */
+int LemVM::compile(string fileName, Program& program) {
+    // Map the file
+    if (!program.source.open(fileName)) {
+        errorHandler.handleErrorNoLine("Could not open file: " + fileName);
+        return 1;
+    }
+    return compileSource(fileName, program);
+}
+
+/**
+ * Compiles the mapped source file of a program, see compile().
+ * 
+ * The file is read in two passes over the mapping. The first one only looks for the "#DATA" and "#CODE" lines,
+ * since a later "#CODE" line moves the start of the code section like it always has. The second one interprets the data section
+ * and compiles the code section. Neither pass copies a line, and both release the pages they have read (see LineReader),
+ * so the memory still grows with the number of instructions and not with the size of the file, but the file is read twice.
+ * 
+ * @param fileName The name of the source file.
+ * @param program The program to compile into, its source file must already be mapped.
+ * @return 0 if the file was compiled successfully, 1 otherwise.
+ */
+int LemVM::compileSource(string fileName, Program& program) {
+    program.fileName = fileName;
+    program.valueBits = options.valueBits;
+    if (program.source.getSize() > UINT32_MAX) {
+        errorHandler.handleErrorNoLine("File is too large, LemASM files can be at most 4 GiB: " + fileName);
+        return 1;
+    }
+
+    /* First we need to determine if the line is a comment or empty.
+     * If it is a comment or empty, we can skip it.
+     *  If it is not a comment or empty, we can check if it is a section.
+     * If it is a section, we can determine if it is the data section or the code section.
+     *  If it is the data section, we can add the string to the string map.
+     *      If the program has a data section, it must come before the code section.
+     *  If it is the code section, we can interpret the line.
+     *      Once the program enters the code section, it will run until it reaches the return statement.
+     * 
+     * This first pass only finds the line numbers where the sections start, nothing is copied out of the file.
+     * If debug mode is on, we will print the line number and the line as well.
+     */
+    LineReader scanner(program.source);
+    string_view line; // The current line being read
+    while (scanner.next(line)) {
+        int lineNumber = scanner.getLineIndex(); // The current line number
+        if(line == "#DATA") program.dataSectionLine = lineNumber;
+        else if(line == "#CODE") program.codeSectionLine = lineNumber;
+
+        if (options.debugMode) cout << lineNumber << ": " << line << endl;
+    }
+
+    // Interpret the data section, then compile the code section, both are read in the second pass
+    LineReader reader(program.source);
+    if (dataSection(program, reader) != 0) return 1;
+    if (compileCodeSection(program, reader) != 0) return 1;
+
+    // Copy the lines the instructions were compiled from out of the file, so that an error never reads the file once it is closed
+    size_t lineArenaSize = 0;
+    for (const LineRef& line : program.lineRefs) lineArenaSize += line.length;
+    program.lineArena.reserve(lineArenaSize);
+    for (LineRef& line : program.lineRefs) {
+        uint32_t offset = program.lineArena.size();
+        program.lineArena.append(program.source.getData() + line.offset, line.length);
+        line.offset = offset;
+    }
+    program.lines = program.lineRefs.data();
+    program.lineData = program.lineArena.data();
+
+    // Verify the stack usage, a program that underflows on every run is rejected before it runs
+    StackVerifier verifier(program.instructions, options.stackSize, options.trapOverflow);
+    if (verifier.verify(program, errorHandler) != 0) return 1;
+
+    // Optimize the program, then verify it again so that a program that is known to be safe can skip the stack checks.
+    // Debug mode prints every instruction as the line it was compiled from, so it runs the program as written.
+    vector<int> indexMap = Optimizer(options.debugMode ? 0 : options.optimizationLevel).optimize(program.instructions);
+    for (auto& label : program.jumpMap) label.second = indexMap[label.second];
+    StackVerifier optimizedVerifier(program.instructions, options.stackSize, options.trapOverflow);
+    optimizedVerifier.analyze();
+    program.underflowSafe = optimizedVerifier.isUnderflowSafe();
+    program.peakDepth = optimizedVerifier.getPeakDepth();
+
+    // Point the execution loop at the compiled program
+    program.code = program.instructions.data();
+    program.codeSize = program.instructions.size();
+    program.constants = program.constantPool.data();
+    program.strings = program.stringRefs.data();
+    program.stringData = program.stringArena.data();
+
+    // Only the compiled program is needed from now on, so a file that is changed while the program runs can not affect it
+    program.source.close();
+    return 0;
+}
+
+/**
+ * Loads the given bytecode file into a program, see BytecodeFile.
+ * The file is memory mapped, so the program runs straight from the mapped pages without being parsed.
+ * 
+ * @param fileName The name of the bytecode file to load.
+ * @param program The program to load into, it must not have been loaded yet.
+ * @return 0 if the file was loaded successfully, 1 otherwise.
+ */
+int LemVM::loadBytecode(string fileName, Program& program) {
+    if (program.bytecodeFile.load(fileName, errorHandler) != 0) return 1;
+    program.fileName = fileName;
+    useBytecode(program);
+    return 0;
+}
+
+/**
+ * Points the execution loop of a program at its loaded bytecode file.
+ * The stack usage is verified straight from the mapped instructions, a program only skips the stack checks if its own instructions are safe.
+ * 
+ * @param program The program whose bytecode file was just loaded.
+ */
+void LemVM::useBytecode(Program& program) {
+    program.code = program.bytecodeFile.getInstructions();
+    program.codeSize = program.bytecodeFile.getInstructionCount();
+    program.constants = program.bytecodeFile.getConstants();
+    program.valueBits = program.bytecodeFile.getValueBits();
+    program.strings = program.bytecodeFile.getStrings();
+    program.stringData = program.bytecodeFile.getData();
+    program.lines = program.bytecodeFile.getLines();
+    program.lineData = program.bytecodeFile.getData();
+
+    // Restore the labels, the tracer, the profiler and debug mode refer to the program by them
+    const LabelRef* labels = program.bytecodeFile.getLabels();
+    for (int i = 0; i < program.bytecodeFile.getLabelCount(); i++) {
+        program.jumpMap[string(program.lineData + labels[i].offset, labels[i].length)] = labels[i].target;
+    }
+    StackVerifier verifier(program.code, program.codeSize, options.stackSize, options.trapOverflow);
+    verifier.analyze();
+    program.underflowSafe = verifier.isUnderflowSafe();
+    program.peakDepth = verifier.getPeakDepth();
+}
+
+/**
+ * Loads a source file from the parse cache, or compiles it and stores it in the cache if it is not there yet.
+ * A hit is loaded like a bytecode file, so neither the data section nor the code section is read.
+ * An entry that can not be loaded, because it is stale or corrupt, is treated as a miss and replaced.
+ * 
+ * @param fileName The name of the source file.
+ * @param program The program to load into, it must not have been loaded yet.
+ * @return 0 if the file was loaded successfully, 1 otherwise.
+ */
+int LemVM::loadCached(string fileName, Program& program) {
+    auto start = chrono::steady_clock::now();
+    auto elapsed = [&]() {
+        return (uint64_t) chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    };
+
+    if (!program.source.open(fileName)) {
+        errorHandler.handleErrorNoLine("Could not open file: " + fileName);
+        return 1;
+    }
+
+    string entryName = cache.entryName(program.source.getData(), program.source.getSize(), options.optimizationLevel, options.valueBits);
+    if (program.bytecodeFile.load(entryName, errorHandler, false) == 0) {
+        program.source.close();
+        program.fileName = fileName;
+        useBytecode(program);
+        cache.recordHit(elapsed());
+        return 0;
+    }
+
+    if (compileSource(fileName, program) != 0) {
+        cache.recordMiss(elapsed());
+        return 1;
+    }
+    string temporaryName = cache.temporaryName(entryName);
+    if (writeBytecodeFile(program, temporaryName) == 0) cache.store(entryName, temporaryName);
+    else cache.discard(temporaryName);
+    cache.recordMiss(elapsed());
+    return 0;
+}
+
+/**
+ * Loads the given file into a program, files that end in .lbc are loaded as bytecode and every other file is compiled.
+ * If the parse cache is enabled, source files go through the cache, except in debug mode which has to print every line it reads.
+ * 
+ * @param fileName The name of the file to load.
+ * @param program The program to load into, it must not have been loaded yet.
+ * @return 0 if the file was loaded successfully, 1 otherwise.
+ */
+int LemVM::load(string fileName, Program& program) {
+    size_t dot = fileName.find_last_of('.');
+    if (dot != string::npos && fileName.substr(dot + 1) == "lbc") return loadBytecode(fileName, program);
+    if (cache.isEnabled() && !options.debugMode) return loadCached(fileName, program);
+    return compile(fileName, program);
+}
+
+/**
+ * Writes a compiled program to a bytecode file, see writeBytecodeFile().
+ * 
+ * @param program The program to write, it must have been compiled from a source file.
+ * @param fileName The name of the bytecode file to write.
+ * @return 0 if the file was written successfully, 1 otherwise.
+ */
+int LemVM::writeBytecode(const Program& program, string fileName) {
+    if (program.isBytecode()) {
+        errorHandler.handleErrorNoLine("Program is already bytecode: " + program.fileName);
+        return 1;
+    }
+
+    if (writeBytecodeFile(program, fileName) != 0) {
+        errorHandler.handleErrorNoLine("Could not write file: " + fileName);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Writes a program that was compiled from a source file to a bytecode file, without reporting errors.
+ * Only the lines that instructions were compiled from are stored, after the strings in the string data, followed by the names of the labels.
+ * 
+ * @param program The program to write.
+ * @param fileName The name of the bytecode file to write.
+ * @return 0 if the file was written successfully, 1 otherwise.
+ */
+int LemVM::writeBytecodeFile(const Program& program, string fileName) {
+    vector<Instruction> instructions = program.instructions;
+    vector<LineRef> lineRefs;
+    map<int, int> lineIndexes; // The index in the lineRefs of every line index that is used.
+    string data = program.stringArena;
+    for (Instruction& instruction : instructions) {
+        if (instruction.lineIndex == -1) continue;
+        auto entry = lineIndexes.find(instruction.lineIndex);
+        if (entry == lineIndexes.end()) {
+            Line line = program.lineAt(instruction.lineIndex);
+            string contents = line.getContents();
+            entry = lineIndexes.insert({instruction.lineIndex, lineRefs.size()}).first;
+            lineRefs.push_back({line.getLineNumber(), (uint32_t) data.size(), (uint32_t) contents.size()});
+            data += contents;
+        }
+        instruction.lineIndex = entry->second;
+    }
+
+    vector<LabelRef> labelRefs;
+    for (auto const& label : program.jumpMap) {
+        labelRefs.push_back({label.second, (uint32_t) data.size(), (uint32_t) label.first.size()});
+        data += label.first;
+    }
+
+    return BytecodeFile::write(fileName, instructions, program.constantPool, program.stringRefs, lineRefs, labelRefs, data, program.valueBits);
+}
+
+/**
+ * Translates a compiled program to C, see CEmitter.
+ * 
+ * @param program The program to translate, it must have been compiled from a source file.
+ * @param fileName The name of the C file to write.
+ * @param stackSize The number of values the stack of the C program can hold.
+ * @return 0 if the file was written successfully, 1 otherwise.
+ */
+int LemVM::emitC(const Program& program, string fileName, int stackSize) {
+    if (program.isBytecode()) {
+        errorHandler.handleErrorNoLine("Program is already bytecode: " + program.fileName);
+        return 1;
+    }
+
+    ofstream cFile(fileName);
+    if (!cFile.is_open()) {
+        errorHandler.handleErrorNoLine("Could not open file: " + fileName);
+        return 1;
+    }
+    CEmitter(program.instructions, program, stackSize, options.seeded, options.seed, !program.isVerified(stackSize), options.trapOverflow).emit(cFile, program.fileName);
+    return 0;
+}
+
+/**
+ * Gets the parse cache, for its statistics.
+ * 
+ * @return The parse cache.
+ */
+const ParseCache& LemVM::getCache() const {
+    return cache;
+}
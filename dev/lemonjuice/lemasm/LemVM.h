@@ -0,0 +1,113 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "Context.h"
+#include "ErrorHandler.h"
+#include "Instruction.h"
+#include "ParseCache.h"
+#include "Snapshot.h"
+#include "Program.h"
+#include "SourceFile.h"
+#include "Tracer.h"
+
+using namespace std;
+
+// Threaded dispatch needs labels as values, which is a GCC and Clang extension.
+#if defined(LEMASM_THREADED_DISPATCH) && !defined(__GNUC__)
+#undef LEMASM_THREADED_DISPATCH
+#endif
+
+// How a LemVM compiles and runs programs, the defaults match the LemASM command line.
+struct VMOptions {
+    bool debugMode = false;          // Print every line that is read and every instruction that is executed.
+    int optimizationLevel = 2;       // How much the optimizer optimizes compiled programs, from 0 to 2.
+    int valueBits = 32;              // The width of the values of compiled programs, 32 or 64, see Program.
+    bool trapOverflow = false;       // Stop with an error when arithmetic overflows, instead of wrapping around.
+    int stackSize = Context::DEFAULT_STACK_SIZE; // The number of values the stack of a run can hold, programs are verified against it.
+#ifdef LEMASM_THREADED_DISPATCH
+    bool threadedDispatch = true;    // Use the threaded execution engine instead of the switch engine.
+#else
+    bool threadedDispatch = false;   // Use the threaded execution engine instead of the switch engine.
+#endif
+    bool jitMode = false;            // Compile programs to native code before they run.
+    bool profileMode = false;        // Profile every run, see Profiler.
+    string profileFileName = "";     // The file the folded stacks of the profile are written to.
+    bool traceMode = false;          // Trace every run, see Tracer.
+    TraceFilter traceFilter;         // Which instructions the tracer records.
+    int traceCapacity = 1 << 16;     // How many records the ring buffer of the tracer holds.
+    int traceSampleRate = 1;         // Only every traceSampleRate-th instruction that passes the filter is recorded.
+    int traceErrorCount = 0;         // If not 0, only this many records are printed and only if the run fails.
+    string traceFileName = "";       // The file the trace is written to, or "" for the error stream.
+    bool statsMode = false;          // Collect the statistics of every run, see Statistics.
+    string statsFileName = "";       // The file the statistics are written to as JSON, or "" to print them as a table to the error stream.
+    string cacheDirectory = "";      // The directory of the parse cache, or "" to always compile, see ParseCache.
+    int64_t maxSteps = 0;            // Stop a run with an error once it has executed more than this many instructions after optimization, or 0 for no limit.
+    int64_t timeoutMilliseconds = 0; // Stop a run with an error once it has run for longer than this, or 0 for no limit.
+    string snapshotFileName = "";    // The file snapshots are written to on SIGUSR1 and every snapshotInterval steps, or "" for no snapshots. They are only written by a forked child in a single-threaded process.
+    int64_t snapshotInterval = 0;    // Take a snapshot once this many instructions have executed since the last one, or 0 to only take them on SIGUSR1.
+    bool seeded = false;             // Reseed the random number generator of the context with seed at the start of every run.
+    uint64_t seed = 0;               // The seed of every run if seeded is set, see Random.
+};
+
+/**
+ * The LemASM virtual machine, it compiles or loads programs and runs them.
+ * A LemVM holds no state of its own besides its options and the statistics of its parse cache, everything a run changes lives in a Context,
+ * so a program can be loaded once and run many times, and a single LemVM can run programs on several threads at once.
+ * 
+ * Example:
+ *     LemVM vm;
+ *     Program program;
+ *     if (vm.load("hello_world.lemasm", program) != 0) return 1;
+ *     Context context;
+ *     int result = vm.run(program, context);
+ */
+class LemVM {
+private:
+    VMOptions options;
+    ErrorHandler errorHandler;
+    ParseCache cache;
+
+    int dataSection(Program& program, LineReader& reader);
+    int compileCodeSection(Program& program, LineReader& reader);
+    int compileSource(string fileName, Program& program);
+    void useBytecode(Program& program);
+    int loadCached(string fileName, Program& program);
+    int writeBytecodeFile(const Program& program, string fileName);
+
+    int runtimeError(const Program& program, Context& context, string errorMessage, const Instruction& instruction);
+    int stackOverflowError(const Program& program, Context& context, const Instruction& instruction);
+    int overflowError(const Program& program, Context& context, const Instruction& instruction);
+    void printDebugInfo(const Program& program, Context& context, const Instruction& instruction);
+    void instrument(Context& context, int pc, Opcode opcode, int depth, int64_t top);
+    void instrumentJump(Context& context, Opcode opcode);
+    int64_t nextCheckpoint(const Context& context, int64_t steps);
+    template <typename Value>
+    int checkLimits(const Program& program, Context& context, const Instruction& instruction, int target, const Value* stack, int64_t depth,
+                    int64_t steps, int64_t& checkpoint, chrono::steady_clock::time_point deadline);
+    template <typename Value>
+    void saveSnapshot(const Program& program, Context& context, int pc, const Value* stack, int64_t depth, int64_t steps);
+    void waitForSnapshot(Context& context);
+
+    template <typename Value, bool Trapping, bool Threaded, bool Checked, bool Instrumented, bool Limited>
+    int executeProgram(const Program& program, Context& context);
+    template <typename Value, bool Trapping>
+    int runEngine(const Program& program, Context& context);
+    bool runJit(const Program& program, Context& context, int& result);
+    void reportProfile(const Program& program, Context& context);
+    int startTrace(const Program& program, Context& context);
+    void reportTrace(Context& context);
+    void reportStatistics(Context& context);
+
+public:
+    LemVM(VMOptions options = VMOptions());
+
+    int compile(string fileName, Program& program);
+    int loadBytecode(string fileName, Program& program);
+    int load(string fileName, Program& program);
+    int run(const Program& program, Context& context);
+    int resume(const Program& program, Context& context, string snapshotFileName);
+    int writeBytecode(const Program& program, string fileName);
+    int emitC(const Program& program, string fileName, int stackSize);
+    const ParseCache& getCache() const;
+};
@@ -11,7 +11,7 @@ Line::Line(int lineNumber, string contents): lineNumber(lineNumber), contents(co
  * 
  * @return The line number.
  */
-int Line::getLineNumber() {
+int Line::getLineNumber() const {
     return lineNumber;
 }
 
@@ -20,7 +20,7 @@ int Line::getLineNumber() {
  * 
  * @return The contents of the line.
  */
-string Line::getContents() {
+string Line::getContents() const {
     return contents;
 }
 
@@ -29,6 +29,6 @@ string Line::getContents() {
  * 
  * @return The line as a string.
  */
-string Line::getLineAsString() {
+string Line::getLineAsString() const {
     return to_string(lineNumber) + ": " + contents;
 }
\ No newline at end of file
@@ -10,7 +10,7 @@ private:
 
 public:
     Line(int lineNumber, string contents);
-    int getLineNumber();
-    string getContents();
-    string getLineAsString();
+    int getLineNumber() const;
+    string getContents() const;
+    string getLineAsString() const;
 };
@@ -0,0 +1,220 @@
+#include "Optimizer.h"
+#include <climits>
+#include <vector>
+#include "StackVerifier.h"
+
+using namespace std;
+
+// Constructor
+Optimizer::Optimizer(int level): level(level) {}
+
+/**
+ * Folds a binary operation on two constants.
+ * A fold that would overflow, or divide by zero, is left for the execution loop so its behaviour does not change.
+ * 
+ * @param opcode The binary operation.
+ * @param a The second value of the stack.
+ * @param b The top value of the stack.
+ * @param result The folded value.
+ * @return True if the operation was folded, false otherwise.
+ */
+static bool foldConstants(Opcode opcode, int a, int b, int& result) {
+    switch (opcode) {
+        case Opcode::ADD: return !__builtin_add_overflow(a, b, &result);
+        case Opcode::SUB: return !__builtin_sub_overflow(a, b, &result);
+        case Opcode::MUL: return !__builtin_mul_overflow(a, b, &result);
+        case Opcode::DIV:
+            if (b == 0 || (a == INT_MIN && b == -1)) return false;
+            result = a / b;
+            return true;
+        case Opcode::MOD:
+            if (b == 0 || (a == INT_MIN && b == -1)) return false;
+            result = a % b;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Gets the superinstruction that compares the top of the stack with an immediate value.
+ * 
+ * @param jump The conditional jump.
+ * @param keep Whether the superinstruction keeps the top of the stack (DUP, PSH n, Jcc) or pops it (PSH n, Jcc).
+ * @return The superinstruction.
+ */
+static Opcode immediateJump(Opcode jump, bool keep) {
+    switch (jump) {
+        case Opcode::JEQ: return keep ? Opcode::JEQK : Opcode::JEQI;
+        case Opcode::JGT: return keep ? Opcode::JGTK : Opcode::JGTI;
+        case Opcode::JLT: return keep ? Opcode::JLTK : Opcode::JLTI;
+        default: return keep ? Opcode::JNEK : Opcode::JNEI;
+    }
+}
+
+/**
+ * Points every jump that lands on a JMP straight at the final target of the JMP chain.
+ * 
+ * @param program The program to optimize.
+ */
+void Optimizer::threadJumps(vector<Instruction>& program) {
+    for (Instruction& instruction : program) {
+        if (instruction.opcode != Opcode::JMP && !isConditionalJump(instruction.opcode)) continue;
+
+        // The hop limit stops a JMP loop, such as ".a JMP a", from spinning forever.
+        for (int hops = 0; hops < program.size() && program[instruction.target].opcode == Opcode::JMP; hops++) {
+            instruction.target = program[instruction.target].target;
+        }
+    }
+}
+
+/**
+ * Runs a single peephole pass over the program.
+ * 
+ * At -O1 the pass:
+ * - Folds PSH a, PSH b, <ADD|SUB|MUL|DIV|MOD> into a single PSH.
+ * - Removes PSH n, POP as well as DUP, POP and SWP, SWP when the stack is known to be deep enough for them.
+ * - Removes a JMP to the instruction right after it, and instructions that can never be reached.
+ * 
+ * At -O2 the pass also fuses:
+ * - PSH n, <ADD|SUB|MUL> into ADDI, SUBI and MULI.
+ * - PSH n, Jcc into JccI, which compares the popped top of the stack with n.
+ * - DUP, PSH n, Jcc into JccK, which compares the top of the stack with n without popping it.
+ * - DUP, CPP into CPK.
+ * 
+ * A pattern is never matched across a jump target, so only its first instruction may be jumped to.
+ * A fused instruction takes the line of the instruction that could have failed in the original pattern,
+ * so runtime errors still point at the original line with the original message.
+ * Folded and fused patterns push fewer values than the original instructions, so a stack overflow may be reported later, or not at all.
+ * 
+ * @param program The program to optimize.
+ * @param indexMap Is filled with the new index of every old instruction.
+ * @return True if the program changed, false otherwise.
+ */
+bool Optimizer::optimizeOnce(vector<Instruction>& program, vector<int>& indexMap) {
+    int size = program.size();
+    vector<bool> isTarget(size, false);
+    for (const Instruction& instruction : program) {
+        if (instruction.opcode == Opcode::JMP || isConditionalJump(instruction.opcode)) isTarget[instruction.target] = true;
+    }
+
+    // The passes rely on the stack analysis, a program that always underflows is left for the execution loop to report.
+    StackVerifier verifier(program, INT_MAX);
+    if (verifier.analyze() != -1) return false;
+
+    // Gets whether the pattern starting at index has the given length and no jump target inside of it.
+    auto fits = [&](int index, int length) {
+        if (index + length > size) return false;
+        for (int i = index + 1; i < index + length; i++) {
+            if (isTarget[i]) return false;
+        }
+        return true;
+    };
+    auto at = [&](int index) { return program[index].opcode; };
+
+    vector<Instruction> optimized;
+    indexMap.assign(size, 0);
+    bool changed = false;
+    int i = 0;
+    while (i < size) {
+        const Instruction& instruction = program[i];
+        int consumed = 1; // How many instructions of the original program were replaced.
+        indexMap[i] = optimized.size();
+
+        // Instructions that can never be reached are dropped, except for the END instruction.
+        if (!verifier.isReached(i) && at(i) != Opcode::END) {
+            consumed = 1;
+        }
+
+        // PSH a, PSH b, <ADD|SUB|MUL|DIV|MOD> -> PSH (a op b)
+        else if (fits(i, 3) && at(i) == Opcode::PSH && at(i + 1) == Opcode::PSH) {
+            int result;
+            if (foldConstants(at(i + 2), instruction.operand, program[i + 1].operand, result)) {
+                optimized.push_back({Opcode::PSH, result, 0, instruction.lineIndex});
+                consumed = 3;
+            } else {
+                optimized.push_back(instruction);
+            }
+        }
+
+        // PSH n, POP -> nothing
+        else if (fits(i, 2) && at(i) == Opcode::PSH && at(i + 1) == Opcode::POP) {
+            consumed = 2;
+        }
+
+        // DUP, POP -> nothing, SWP, SWP -> nothing
+        else if (fits(i, 2) && ((at(i) == Opcode::DUP && at(i + 1) == Opcode::POP) || (at(i) == Opcode::SWP && at(i + 1) == Opcode::SWP))
+                 && verifier.getMinimumDepth(i) >= stackRequired(at(i))) {
+            consumed = 2;
+        }
+
+        // JMP to the next instruction -> nothing
+        else if (at(i) == Opcode::JMP && instruction.target == i + 1) {
+            consumed = 1;
+        }
+
+        // DUP, PSH n, Jcc -> JccK n
+        else if (level >= 2 && fits(i, 3) && at(i) == Opcode::DUP && at(i + 1) == Opcode::PSH && isConditionalJump(at(i + 2))
+                 && stackRequired(at(i + 2)) == 2) {
+            optimized.push_back({immediateJump(at(i + 2), true), program[i + 1].operand, program[i + 2].target, instruction.lineIndex});
+            consumed = 3;
+        }
+
+        // PSH n, Jcc -> JccI n
+        else if (level >= 2 && fits(i, 2) && at(i) == Opcode::PSH && isConditionalJump(at(i + 1)) && stackRequired(at(i + 1)) == 2) {
+            optimized.push_back({immediateJump(at(i + 1), false), instruction.operand, program[i + 1].target, program[i + 1].lineIndex});
+            consumed = 2;
+        }
+
+        // PSH n, <ADD|SUB|MUL> -> <ADDI|SUBI|MULI> n
+        else if (level >= 2 && fits(i, 2) && at(i) == Opcode::PSH && (at(i + 1) == Opcode::ADD || at(i + 1) == Opcode::SUB || at(i + 1) == Opcode::MUL)) {
+            Opcode fused = at(i + 1) == Opcode::ADD ? Opcode::ADDI : at(i + 1) == Opcode::SUB ? Opcode::SUBI : Opcode::MULI;
+            optimized.push_back({fused, instruction.operand, 0, program[i + 1].lineIndex});
+            consumed = 2;
+        }
+
+        // DUP, CPP -> CPK
+        else if (level >= 2 && fits(i, 2) && at(i) == Opcode::DUP && at(i + 1) == Opcode::CPP) {
+            optimized.push_back({Opcode::CPK, 0, 0, instruction.lineIndex});
+            consumed = 2;
+        }
+
+        else {
+            optimized.push_back(instruction);
+        }
+
+        for (int j = i + 1; j < i + consumed; j++) indexMap[j] = optimized.size();
+        if (consumed > 1 || optimized.size() == indexMap[i]) changed = true;
+        i += consumed;
+    }
+
+    // Jumps that pointed at a removed instruction now point at the instruction that followed it.
+    for (Instruction& instruction : optimized) {
+        if (instruction.opcode == Opcode::JMP || isConditionalJump(instruction.opcode)) instruction.target = indexMap[instruction.target];
+    }
+
+    program = optimized;
+    return changed;
+}
+
+/**
+ * Optimizes the program with peephole passes until it stops changing.
+ * At -O0 the program is left as it is.
+ * 
+ * @param program The program to optimize, it must end with an END instruction.
+ * @return The new index of every instruction of the original program, so labels can be updated.
+ */
+vector<int> Optimizer::optimize(vector<Instruction>& program) {
+    vector<int> indexMap(program.size());
+    for (int i = 0; i < program.size(); i++) indexMap[i] = i;
+    if (level <= 0) return indexMap;
+
+    threadJumps(program);
+    vector<int> passMap;
+    while (optimizeOnce(program, passMap)) {
+        for (int& index : indexMap) index = passMap[index];
+        threadJumps(program);
+    }
+
+    return indexMap;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <vector>
+#include "Instruction.h"
+
+using namespace std;
+
+class Optimizer {
+private:
+    int level;
+
+    bool optimizeOnce(vector<Instruction>& program, vector<int>& indexMap);
+    void threadJumps(vector<Instruction>& program);
+
+public:
+    Optimizer(int level);
+    vector<int> optimize(vector<Instruction>& program);
+};
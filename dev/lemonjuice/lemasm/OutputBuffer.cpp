@@ -0,0 +1,193 @@
+#include "OutputBuffer.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// The two digit decimal representation of every number from 0 to 99, used to format two digits at a time.
+static const char digitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Constructor
+OutputBuffer::OutputBuffer(): length(0), written(0), file(stdout), capturing(false) {}
+
+// Destructor
+OutputBuffer::~OutputBuffer() {
+    flush();
+    if (file != stdout) fclose(file);
+}
+
+/**
+ * Sends everything written from now on to the given file instead of the console.
+ * 
+ * @param fileName The name of the file to write to, it is created if it does not exist.
+ * @param truncate Whether an existing file is truncated, if not it is kept so that a resumed run can continue it, see seek().
+ * @return True if the file was opened, false otherwise.
+ */
+bool OutputBuffer::open(string fileName, bool truncate) {
+    FILE* opened = truncate ? nullptr : fopen(fileName.c_str(), "r+b");
+    if (opened == nullptr) opened = fopen(fileName.c_str(), "wb");
+    if (opened == nullptr) return false;
+    flush();
+    if (file != stdout) fclose(file);
+    file = opened;
+    return true;
+}
+
+/**
+ * Moves the output back to where it was when a snapshot was taken, so that a resumed run continues it, see Snapshot.
+ * A file is cut off at the position and written from there, the console can not be rewound so only the byte count is restored.
+ * 
+ * @param position How many bytes had been written when the snapshot was taken.
+ * @return True if the output was moved, false if the file is shorter than the position.
+ */
+bool OutputBuffer::seek(uint64_t position) {
+    flush();
+    if (file != stdout) {
+        struct stat status;
+        if (fstat(fileno(file), &status) != 0 || (uint64_t) status.st_size < position) return false;
+        if (ftruncate(fileno(file), position) != 0 || fseeko(file, position, SEEK_SET) != 0) return false;
+    }
+    written = position;
+    return true;
+}
+
+/**
+ * Keeps everything written from now on in memory instead of writing it to the console or a file, see getCaptured().
+ * This is how the batch runner gives every job its own output.
+ */
+void OutputBuffer::capture() {
+    flush();
+    capturing = true;
+}
+
+/**
+ * Gets everything that was written since capture() was called, up to the last flush.
+ * 
+ * @return The captured output.
+ */
+const string& OutputBuffer::getCaptured() const {
+    return captured;
+}
+
+/**
+ * Writes characters straight to the file, or to the captured output if capture() was called.
+ * 
+ * @param data The characters to write.
+ * @param size The number of characters.
+ */
+void OutputBuffer::write(const char* data, size_t size) {
+    written += size;
+    if (capturing) captured.append(data, size);
+    else fwrite(data, 1, size, file);
+}
+
+/**
+ * Formats an integer followed by a newline, right to left into a small scratch buffer, two digits at a time.
+ * 
+ * @param value The integer to format.
+ * @param end The end of the scratch buffer.
+ * @return The first character of the formatted integer.
+ */
+template <typename Signed>
+static char* formatLine(Signed value, char* end) {
+    typedef make_unsigned_t<Signed> Unsigned;
+    char* start = end;
+    *--start = '\n';
+
+    Unsigned magnitude = value < 0 ? (Unsigned) 0 - (Unsigned) value : (Unsigned) value;
+    while (magnitude >= 100) {
+        Unsigned pair = magnitude % 100;
+        magnitude /= 100;
+        start -= 2;
+        memcpy(start, digitPairs + pair * 2, 2);
+    }
+    if (magnitude >= 10) {
+        start -= 2;
+        memcpy(start, digitPairs + magnitude * 2, 2);
+    } else {
+        *--start = (char) ('0' + magnitude);
+    }
+    if (value < 0) *--start = '-';
+    return start;
+}
+
+/**
+ * Writes an integer followed by a newline.
+ * 
+ * @param value The integer to write.
+ */
+void OutputBuffer::writeLine(int value) {
+    char digits[12]; // Room for the sign, 10 digits and the newline.
+    char* end = digits + sizeof(digits);
+    char* start = formatLine(value, end);
+
+    size_t size = end - start;
+    if (length + size > BUFFER_SIZE) flush();
+    memcpy(buffer + length, start, size);
+    length += size;
+}
+
+/**
+ * Writes a 64-bit integer followed by a newline.
+ * 
+ * @param value The integer to write.
+ */
+void OutputBuffer::writeLine(int64_t value) {
+    char digits[21]; // Room for the sign, 19 digits and the newline.
+    char* end = digits + sizeof(digits);
+    char* start = formatLine(value, end);
+
+    size_t size = end - start;
+    if (length + size > BUFFER_SIZE) flush();
+    memcpy(buffer + length, start, size);
+    length += size;
+}
+
+/**
+ * Writes a string followed by a newline.
+ * A string that does not fit in the buffer is written out directly.
+ * 
+ * @param data The characters of the string.
+ * @param size The number of characters.
+ */
+void OutputBuffer::writeLine(const char* data, size_t size) {
+    if (length + size + 1 > BUFFER_SIZE) {
+        flush();
+        if (size + 1 > BUFFER_SIZE) {
+            write(data, size);
+            write("\n", 1);
+            flush();
+            return;
+        }
+    }
+    memcpy(buffer + length, data, size);
+    length += size;
+    buffer[length++] = '\n';
+}
+
+/**
+ * Writes out everything in the buffer.
+ * This is done when the buffer is full, when the program ends or fails, and when it executes FLS.
+ */
+void OutputBuffer::flush() {
+    if (length > 0) write(buffer, length);
+    length = 0;
+    if (!capturing) fflush(file);
+}
+
+/**
+ * Gets how many bytes have been written since the buffer was created, including those that were not flushed yet.
+ * 
+ * @return The number of bytes written.
+ */
+uint64_t OutputBuffer::getBytesWritten() const {
+    return written + length;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+using namespace std;
+
+/**
+ * The buffered writer that everything a program prints goes through.
+ * Values are formatted straight into a large buffer, which is only written out when it is full or flush() is called,
+ * so a program that prints a lot of values makes a handful of writes instead of one per value.
+ */
+class OutputBuffer {
+private:
+    static const size_t BUFFER_SIZE = 1 << 16;
+
+    char buffer[BUFFER_SIZE];
+    size_t length;
+    uint64_t written;
+    FILE* file;
+    bool capturing;
+    string captured;
+
+    void write(const char* data, size_t size);
+
+public:
+    OutputBuffer();
+    ~OutputBuffer();
+
+    bool open(string fileName, bool truncate = true);
+    bool seek(uint64_t position);
+    void capture();
+    const string& getCaptured() const;
+    void writeLine(int value);
+    void writeLine(int64_t value);
+    void writeLine(const char* data, size_t size);
+    void flush();
+    uint64_t getBytesWritten() const;
+};
@@ -0,0 +1,136 @@
+#include "ParseCache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "BytecodeFile.h"
+
+using namespace std;
+
+// The environment variable that sets the cache directory when --cache-dir is not given.
+static const char* const CACHE_DIRECTORY_VARIABLE = "LEMASM_CACHE_DIR";
+
+// Identifies the build of the interpreter, so that a rebuilt interpreter never uses entries compiled by an older one.
+static const char* const BUILD_ID = __DATE__ " " __TIME__;
+
+// Constructor
+ParseCache::ParseCache(string directory)
+    : directory(directory), hits(0), misses(0), writeFailures(0), hitNanoseconds(0), missNanoseconds(0) {}
+
+/**
+ * Gets the cache directory from the LEMASM_CACHE_DIR environment variable.
+ * 
+ * @return The directory, or "" if the variable is not set.
+ */
+string ParseCache::directoryFromEnvironment() {
+    const char* value = getenv(CACHE_DIRECTORY_VARIABLE);
+    return value == nullptr ? "" : value;
+}
+
+/**
+ * Gets whether the cache has a directory, a cache without one never hits and stores nothing.
+ * 
+ * @return True if the cache is enabled, false otherwise.
+ */
+bool ParseCache::isEnabled() const {
+    return !directory.empty();
+}
+
+/**
+ * Gets the file name of the entry for a source file.
+ * 
+ * @param source The bytes of the source file.
+ * @param size The number of bytes of the source file.
+ * @param optimizationLevel The optimization level the program is compiled with.
+ * @param valueBits The width of the values the program is compiled with.
+ * @return The path of the entry in the cache directory.
+ */
+string ParseCache::entryName(const char* source, size_t size, int optimizationLevel, int valueBits) const {
+    string suffix = string(1, '\0') + to_string(BYTECODE_VERSION) + " " + to_string(optimizationLevel) + " " + to_string(valueBits)
+                  + " " + BUILD_ID;
+    uint64_t hash = BytecodeFile::checksum(source, size);
+    hash = BytecodeFile::checksum(suffix.data(), suffix.size(), hash);
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hash);
+    return (filesystem::path(directory) / (string(hex) + ".lbc")).string();
+}
+
+/**
+ * Gets a file name to write a new entry to before it is stored, and creates the cache directory if it does not exist yet.
+ * The name is unique to the process and thread, so processes and threads that miss on the same source never write the same file.
+ * 
+ * @param entryName The path of the entry, see entryName().
+ * @return The path of the temporary file.
+ */
+string ParseCache::temporaryName(const string& entryName) const {
+    error_code error;
+    filesystem::create_directories(directory, error);
+    return entryName + "." + to_string(getpid()) + "." + to_string(hash<thread::id>()(this_thread::get_id())) + ".tmp";
+}
+
+/**
+ * Moves a freshly written bytecode file into its place in the cache.
+ * The file is renamed into place, so other processes either see the whole entry or none of it.
+ * 
+ * @param entryName The path of the entry, see entryName().
+ * @param temporaryName The bytecode file to move, it is removed if it can not be moved.
+ * @return True if the entry was stored, false otherwise.
+ */
+bool ParseCache::store(const string& entryName, const string& temporaryName) {
+    error_code error;
+    filesystem::rename(temporaryName, entryName, error);
+    if (error) {
+        discard(temporaryName);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Removes a bytecode file that could not be written completely, and counts the failed write.
+ * 
+ * @param temporaryName The bytecode file to remove.
+ */
+void ParseCache::discard(const string& temporaryName) {
+    error_code error;
+    filesystem::remove(temporaryName, error);
+    writeFailures++;
+}
+
+/**
+ * Counts a program that was loaded from the cache.
+ * 
+ * @param nanoseconds How long the load took.
+ */
+void ParseCache::recordHit(uint64_t nanoseconds) {
+    hits++;
+    hitNanoseconds += nanoseconds;
+}
+
+/**
+ * Counts a program that was not in the cache and had to be compiled.
+ * 
+ * @param nanoseconds How long the compile took, including storing the entry.
+ */
+void ParseCache::recordMiss(uint64_t nanoseconds) {
+    misses++;
+    missNanoseconds += nanoseconds;
+}
+
+/**
+ * Prints the cache statistics, for the --cache-stats flag.
+ * 
+ * @param out The stream to print to.
+ */
+void ParseCache::report(ostream& out) const {
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "Cache: %llu hits (%.3f ms loading), %llu misses (%.3f ms compiling), %llu failed writes.",
+             (unsigned long long) hits, hitNanoseconds / 1e6, (unsigned long long) misses, missNanoseconds / 1e6,
+             (unsigned long long) writeFailures);
+    out << endl << buffer << endl;
+    if (!isEnabled()) out << "The cache is disabled, use --cache-dir or " << CACHE_DIRECTORY_VARIABLE << "." << endl;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+using namespace std;
+
+/**
+ * An on-disk cache of compiled programs, for the --cache-dir flag.
+ * 
+ * Every entry is a bytecode (.lbc) file named after a hash of the source bytes, the bytecode version,
+ * the optimization level, the value width and the build of the interpreter, so an entry is never used for a source file
+ * that changed or by an interpreter that would compile it differently.
+ * A hit is loaded like any other bytecode file, without reading the data section or compiling the code section.
+ * 
+ * The counters are atomic, so a single cache can be shared by the threads of a batch.
+ */
+class ParseCache {
+private:
+    string directory;
+    atomic<uint64_t> hits;
+    atomic<uint64_t> misses;
+    atomic<uint64_t> writeFailures;
+    atomic<uint64_t> hitNanoseconds;
+    atomic<uint64_t> missNanoseconds;
+
+public:
+    ParseCache(string directory);
+
+    bool isEnabled() const;
+    string entryName(const char* source, size_t size, int optimizationLevel, int valueBits) const;
+    string temporaryName(const string& entryName) const;
+    bool store(const string& entryName, const string& temporaryName);
+    void discard(const string& temporaryName);
+    void recordHit(uint64_t nanoseconds);
+    void recordMiss(uint64_t nanoseconds);
+    void report(ostream& out) const;
+
+    static string directoryFromEnvironment();
+};
@@ -0,0 +1,184 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#ifdef LEMASM_PROFILE_CYCLES
+static const char* const TICK_UNIT = "cycles";
+#else
+static const char* const TICK_UNIT = "ns";
+#endif
+
+// How many of the hottest lines the report shows.
+static const int HOT_LINE_COUNT = 20;
+
+// The totals of one row of the report.
+struct ProfileRow {
+    string name;
+    uint64_t count;
+    uint64_t ticks;
+};
+
+// Constructor
+Profiler::Profiler(): current(0), last(0) {}
+
+/**
+ * Clears the counters and starts the clock.
+ * 
+ * @param size The number of instructions of the program.
+ */
+void Profiler::start(int size) {
+    counts.assign(size, 0);
+    ticks.assign(size, 0);
+    current = 0;
+    last = now();
+}
+
+/**
+ * Stops the clock, the time since the last instruction started is added to that instruction.
+ */
+void Profiler::finish() {
+    uint64_t time = now();
+    ticks[current] += time - last;
+    last = time;
+}
+
+/**
+ * Gets the name of the basic block every instruction belongs to.
+ * A block starts at every label, the instructions before the first label belong to the "(entry)" block.
+ * 
+ * @param size The number of instructions of the program.
+ * @param jumpMap The labels of the program.
+ * @return The name of the block of every instruction.
+ */
+vector<string> Profiler::blockNames(int size, const map<string, int>& jumpMap) {
+    vector<string> starts(size);
+    for (auto const& x : jumpMap) {
+        if (x.second >= size) continue;
+        starts[x.second] += (starts[x.second].empty() ? "." : ",.") + x.first;
+    }
+
+    vector<string> names(size);
+    string name = "(entry)";
+    for (int i = 0; i < size; i++) {
+        if (!starts[i].empty()) name = starts[i];
+        names[i] = name;
+    }
+    return names;
+}
+
+/**
+ * Prints the rows of one table of the report, the hottest first.
+ * 
+ * @param out The stream to print to.
+ * @param title The title of the table.
+ * @param rows The rows, they are sorted in place.
+ * @param limit The maximum number of rows to print.
+ * @param totalTicks The ticks of the whole program, used for the percentages.
+ */
+static void printTable(ostream& out, const string& title, vector<ProfileRow>& rows, int limit, uint64_t totalTicks) {
+    sort(rows.begin(), rows.end(), [](const ProfileRow& a, const ProfileRow& b) {
+        return a.ticks != b.ticks ? a.ticks > b.ticks : a.count > b.count;
+    });
+
+    out << endl << title << ":" << endl;
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%14s %16s %7s  ", "Count", TICK_UNIT, "%");
+    out << buffer << "Name" << endl;
+    for (int i = 0; i < rows.size() && i < limit; i++) {
+        if (rows[i].count == 0) break;
+        double percent = totalTicks == 0 ? 0 : 100.0 * rows[i].ticks / totalTicks;
+        snprintf(buffer, sizeof(buffer), "%14llu %16llu %6.2f%%  ", (unsigned long long) rows[i].count, (unsigned long long) rows[i].ticks, percent);
+        out << buffer << rows[i].name << endl;
+    }
+}
+
+/**
+ * Prints the hot-spot report: the hottest source lines, then the time per opcode and per basic block.
+ * 
+ * @param out The stream to print to.
+ * @param code The instructions of the program.
+ * @param size The number of instructions.
+ * @param lines The source line of every instruction.
+ * @param jumpMap The labels of the program.
+ */
+void Profiler::report(ostream& out, const Instruction* code, int size, const vector<Line>& lines, const map<string, int>& jumpMap) {
+    uint64_t totalCount = 0;
+    uint64_t totalTicks = 0;
+    for (int i = 0; i < size; i++) {
+        totalCount += counts[i];
+        totalTicks += ticks[i];
+    }
+
+    map<int, ProfileRow> lineRows;
+    map<int, ProfileRow> opcodeRows;
+    map<string, ProfileRow> blockRows;
+    vector<string> blocks = blockNames(size, jumpMap);
+    for (int i = 0; i < size; i++) {
+        int lineNumber = lines[i].getLineNumber();
+        ProfileRow& line = lineRows[lineNumber];
+        line.name = "line " + to_string(lineNumber) + ": " + lines[i].getContents();
+        line.count += counts[i];
+        line.ticks += ticks[i];
+
+        ProfileRow& opcode = opcodeRows[(int) code[i].opcode];
+        opcode.name = opcodeName(code[i].opcode);
+        opcode.count += counts[i];
+        opcode.ticks += ticks[i];
+
+        ProfileRow& block = blockRows[blocks[i]];
+        block.name = blocks[i];
+        block.count += counts[i];
+        block.ticks += ticks[i];
+    }
+
+    vector<ProfileRow> rows;
+    out << endl << "Profile: " << totalCount << " instructions executed in " << totalTicks << " " << TICK_UNIT << "." << endl;
+
+    for (auto& x : lineRows) rows.push_back(x.second);
+    printTable(out, "Hottest Lines", rows, HOT_LINE_COUNT, totalTicks);
+
+    rows.clear();
+    for (auto& x : opcodeRows) rows.push_back(x.second);
+    printTable(out, "Opcodes", rows, OPCODE_COUNT, totalTicks);
+
+    rows.clear();
+    for (auto& x : blockRows) rows.push_back(x.second);
+    printTable(out, "Blocks", rows, blockRows.size(), totalTicks);
+}
+
+/**
+ * Writes the profile as folded stacks, the input format of flamegraph.pl and most other flame graph tools.
+ * Every line is "LemASM;<block>;<source line> <time>", so the flame graph groups the lines by their block.
+ * 
+ * @param fileName The name of the file to write.
+ * @param size The number of instructions.
+ * @param lines The source line of every instruction.
+ * @param jumpMap The labels of the program.
+ * @return True if the file was written, false otherwise.
+ */
+bool Profiler::writeFolded(string fileName, int size, const vector<Line>& lines, const map<string, int>& jumpMap) {
+    ofstream file(fileName);
+    if (!file.is_open()) return false;
+
+    map<string, uint64_t> stacks;
+    vector<string> blocks = blockNames(size, jumpMap);
+    for (int i = 0; i < size; i++) {
+        if (ticks[i] == 0) continue;
+        string block = blocks[i];
+        string frame = "line " + to_string(lines[i].getLineNumber()) + ": " + lines[i].getContents();
+        replace(block.begin(), block.end(), ';', ',');
+        replace(frame.begin(), frame.end(), ';', ',');
+        stacks["LemASM;" + block + ";" + frame] += ticks[i];
+    }
+
+    for (auto const& x : stacks) {
+        file << x.first << " " << x.second << "\n";
+    }
+    return file.good();
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Instruction.h"
+#include "Line.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LEMASM_PROFILE_CYCLES
+#endif
+
+using namespace std;
+
+/**
+ * Counts how often every instruction is executed and how much time is spent in it, for the --profile flag.
+ * The time is measured in CPU cycles (rdtsc) on x86, and in nanoseconds of the steady clock everywhere else.
+ */
+class Profiler {
+private:
+    vector<uint64_t> counts;
+    vector<uint64_t> ticks;
+    int current;
+    uint64_t last;
+
+    static uint64_t now() {
+#ifdef LEMASM_PROFILE_CYCLES
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    vector<string> blockNames(int size, const map<string, int>& jumpMap);
+
+public:
+    Profiler();
+    void start(int size);
+    void finish();
+    void report(ostream& out, const Instruction* code, int size, const vector<Line>& lines, const map<string, int>& jumpMap);
+    bool writeFolded(string fileName, int size, const vector<Line>& lines, const map<string, int>& jumpMap);
+
+    /**
+     * Records that the instruction at the given index starts executing.
+     * The time since the previous call is added to the previous instruction.
+     * 
+     * @param index The index of the instruction.
+     */
+    void enter(int index) {
+        uint64_t time = now();
+        ticks[current] += time - last;
+        counts[index]++;
+        current = index;
+        last = time;
+    }
+};
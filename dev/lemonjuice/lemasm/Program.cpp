@@ -0,0 +1,126 @@
+#include "Program.h"
+#include <cstdint>
+#include <map>
+#include <string>
+
+using namespace std;
+
+// Constructor
+Program::Program(): dataSectionLine(0), codeSectionLine(0), valueBits(32), underflowSafe(false), peakDepth(0),
+    code(nullptr), codeSize(0), constants(nullptr), strings(nullptr), stringData(nullptr), lines(nullptr), lineData(nullptr) {}
+
+/**
+ * Gets the name of the file the program was loaded from.
+ * 
+ * @return The file name.
+ */
+string Program::getFileName() const {
+    return fileName;
+}
+
+/**
+ * Gets the instructions of the program, they always end with an END instruction.
+ * 
+ * @return The instructions.
+ */
+const Instruction* Program::getCode() const {
+    return code;
+}
+
+/**
+ * Gets the number of instructions of the program.
+ * 
+ * @return The number of instructions.
+ */
+int Program::getCodeSize() const {
+    return codeSize;
+}
+
+/**
+ * Gets the width of the values of the program.
+ * 
+ * @return 32 or 64.
+ */
+int Program::getValueBits() const {
+    return valueBits;
+}
+
+/**
+ * Gets a literal that does not fit in 32 bits, the same literal a PSHW with this index as its operand pushes.
+ * 
+ * @param index The index of the constant.
+ * @return The constant.
+ */
+int64_t Program::constantAt(int index) const {
+    return constants[index];
+}
+
+/**
+ * Gets the labels of the program, each mapped to the index of the instruction it jumps to.
+ * A program loaded from a bytecode file has no labels.
+ * 
+ * @return The jump map.
+ */
+const map<string, int>& Program::getJumpMap() const {
+    return jumpMap;
+}
+
+/**
+ * Gets the strings of the data section, each mapped to the index of its string, see stringAt().
+ * A program loaded from a bytecode file has no string names.
+ * 
+ * @return The string map.
+ */
+const map<string, int, less<>>& Program::getStringMap() const {
+    return stringMap;
+}
+
+/**
+ * Gets a string of the data section, the same string a CPR with this index as its operand prints.
+ * 
+ * @param index The index of the string.
+ * @return The string.
+ */
+string Program::stringAt(int index) const {
+    return string(stringData + strings[index].offset, strings[index].length);
+}
+
+/**
+ * Gets whether the program was loaded successfully and can be run.
+ * 
+ * @return True if the program can be run, false otherwise.
+ */
+bool Program::isLoaded() const {
+    return code != nullptr;
+}
+
+/**
+ * Gets whether the program was loaded from a bytecode file.
+ * 
+ * @return True if the program was loaded from a bytecode file, false if it was compiled from source.
+ */
+bool Program::isBytecode() const {
+    return bytecodeFile.isLoaded();
+}
+
+/**
+ * Gets whether the program has been verified to never underflow or overflow a stack of the given size.
+ * A verified program is run without stack checks.
+ * 
+ * @param stackSize The number of values the stack can hold.
+ * @return True if the program is verified, false otherwise.
+ */
+bool Program::isVerified(int stackSize) const {
+    return underflowSafe && peakDepth <= stackSize;
+}
+
+/**
+ * Gets the line an instruction was compiled from, either from the source file or from the bytecode file.
+ * 
+ * @param lineIndex The line index of the instruction.
+ * @return The line.
+ */
+Line Program::lineAt(int lineIndex) const {
+    const LineRef& line = lines[lineIndex];
+    return Line(line.lineNumber, string(lineData + line.offset, line.length));
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "BytecodeFile.h"
+#include "Instruction.h"
+#include "Line.h"
+#include "SourceFile.h"
+
+using namespace std;
+
+/**
+ * A compiled LemASM program, either compiled from a source file or loaded from a bytecode file by a LemVM.
+ * A program is never changed by running it, so it can be loaded once and then run any number of times, see Context.
+ * The instructions point into the program itself, so a program can not be copied.
+ * 
+ * A program compiled from source does not keep the text of the file, only the lines that instructions were compiled from, copied into the lineArena
+ * once the file is compiled, so its memory grows with the number of instructions and not with the size of the file. The file is closed after that.
+ * 
+ * The strings of the data section are interned into a single stringArena, and the stringMap only maps every name to the index of its StringRef.
+ * Every CPR operand is that index, so printing a string never allocates or looks anything up.
+ * 
+ * The values of a program are either 32 or 64 bits wide, which is chosen when it is compiled (see VMOptions::valueBits),
+ * so a literal that does not fit is reported before the program runs. Literals that do not fit in the 32-bit operand
+ * of an instruction are kept in the constantPool and pushed by PSHW.
+ */
+class Program {
+private:
+    friend class LemVM;
+
+    string fileName;
+    SourceFile source;
+    vector<LineRef> lineRefs;
+    string lineArena;
+    int dataSectionLine;
+    int codeSectionLine;
+    map<string, int> jumpMap;
+    map<string, int, less<>> stringMap;
+    vector<Instruction> instructions;
+    vector<int64_t> constantPool;
+    string stringArena;
+    vector<StringRef> stringRefs;
+    BytecodeFile bytecodeFile;
+    int valueBits;
+    bool underflowSafe;
+    int peakDepth;
+
+    // What the execution loop runs, it either points at the vectors and arenas above or into the mapped bytecode file.
+    const Instruction* code;
+    int codeSize;
+    const int64_t* constants;
+    const StringRef* strings;
+    const char* stringData;
+    const LineRef* lines;
+    const char* lineData;
+
+public:
+    Program();
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    string getFileName() const;
+    const Instruction* getCode() const;
+    int getCodeSize() const;
+    int getValueBits() const;
+    int64_t constantAt(int index) const;
+    const map<string, int>& getJumpMap() const;
+    const map<string, int, less<>>& getStringMap() const;
+    string stringAt(int index) const;
+    bool isLoaded() const;
+    bool isBytecode() const;
+    bool isVerified(int stackSize) const;
+    Line lineAt(int lineIndex) const;
+};
@@ -0,0 +1,91 @@
+#include "Random.h"
+#include <cstdint>
+#include <random>
+
+using namespace std;
+
+// Constructor, seeds the generator from the system.
+Random::Random() {
+    random_device device;
+    seed(((uint64_t) device() << 32) | device());
+}
+
+// Constructor
+Random::Random(uint64_t seed) {
+    this->seed(seed);
+}
+
+/**
+ * Restarts the generator from a seed, the same seed always draws the same numbers.
+ * The state is filled with splitmix64, so seeds that are close together still start far apart.
+ * 
+ * @param seed The seed.
+ */
+void Random::seed(uint64_t seed) {
+    for (uint64_t& word : state) {
+        seed += 0x9E3779B97F4A7C15ull;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        word = z ^ (z >> 31);
+    }
+}
+
+/**
+ * Copies out the state of the generator, so that it can be saved in a snapshot, see Snapshot.
+ * 
+ * @param words Is set to the four words of the state.
+ */
+void Random::getState(uint64_t words[4]) const {
+    for (int i = 0; i < 4; i++) words[i] = state[i];
+}
+
+/**
+ * Restores a state copied out by getState(), the generator then draws the same numbers it would have drawn back then.
+ * 
+ * @param words The four words of the state.
+ */
+void Random::setState(const uint64_t words[4]) {
+    for (int i = 0; i < 4; i++) state[i] = words[i];
+}
+
+/**
+ * Draws a number from 0 up to, but not including, the bound, without the bias of a plain modulo.
+ * 
+ * @param bound The bound, it must not be 0.
+ * @return The random number.
+ */
+uint64_t Random::below(uint64_t bound) {
+    uint64_t threshold = -bound % bound; // Draws below this would make the low numbers more likely.
+    uint64_t value = next();
+    while (value < threshold) value = next();
+    return value % bound;
+}
+
+/**
+ * Shuffles values in place with a Fisher-Yates shuffle, for ROR.
+ * Both stack widths draw the same numbers, so a seeded 32-bit and 64-bit run shuffle the same way.
+ * 
+ * @param random The generator to draw from.
+ * @param first The first value.
+ * @param last One past the last value.
+ */
+template <typename Value>
+static void shuffleValues(Random& random, Value* first, Value* last) {
+    for (int64_t i = last - first - 1; i > 0; i--) {
+        int64_t j = random.below(i + 1);
+        Value value = first[i];
+        first[i] = first[j];
+        first[j] = value;
+    }
+}
+
+// Shuffles the values of a 32-bit stack, see shuffleValues().
+void Random::shuffle(int* first, int* last) {
+    shuffleValues(*this, first, last);
+}
+
+// Shuffles the values of a 64-bit stack, see shuffleValues().
+void Random::shuffle(int64_t* first, int64_t* last) {
+    shuffleValues(*this, first, last);
+}
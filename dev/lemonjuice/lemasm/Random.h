@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * The random number generator behind RAN and ROR, a xoshiro256** generator.
+ * 
+ * Every Context has its own generator, so programs that run at once never share one.
+ * A generator is seeded from the system once, when it is created, or with a fixed seed for the --seed flag,
+ * in which case every run of a program draws the same numbers in every execution engine.
+ * The emitted C code (see CEmitter) uses the same generator, so it draws the same numbers as well.
+ */
+class Random {
+private:
+    uint64_t state[4];
+
+public:
+    Random();
+    Random(uint64_t seed);
+
+    void seed(uint64_t seed);
+    void getState(uint64_t words[4]) const;
+    void setState(const uint64_t words[4]);
+    uint64_t next();
+    int nextInt();
+    uint64_t below(uint64_t bound);
+    void shuffle(int* first, int* last);
+    void shuffle(int64_t* first, int64_t* last);
+};
+
+/**
+ * Draws the next 64 random bits.
+ * It is defined here so that RAN compiles down to a handful of instructions in the execution loop.
+ * 
+ * @return The random bits.
+ */
+inline uint64_t Random::next() {
+    uint64_t result = state[1] * 5;
+    result = ((result << 7) | (result >> 57)) * 9;
+    uint64_t shifted = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= shifted;
+    state[3] = (state[3] << 45) | (state[3] >> 19);
+    return result;
+}
+
+/**
+ * Draws the value RAN pushes, a number from 0 to 2147483647 like the C rand() it replaces.
+ * 
+ * @return The random number.
+ */
+inline int Random::nextInt() {
+    return (int) (next() >> 33);
+}
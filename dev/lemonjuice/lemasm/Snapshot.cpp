@@ -0,0 +1,187 @@
+#include "Snapshot.h"
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include "BytecodeFile.h"
+
+using namespace std;
+
+static_assert(sizeof(SnapshotHeader) == 88, "The snapshot header layout must not change without a new SNAPSHOT_VERSION.");
+
+// Set by the SIGUSR1 handler, the execution loop takes a snapshot at its next checkpoint once it sees it.
+static volatile sig_atomic_t snapshotRequested = 0;
+
+/**
+ * Remembers that a snapshot was requested, this is the SIGUSR1 handler so it must not do anything else.
+ * 
+ * @param signal The signal that was received.
+ */
+static void requestSnapshot(int signal) {
+    (void) signal;
+    snapshotRequested = 1;
+}
+
+/**
+ * Computes the checksum of a snapshot, the FNV-1a hash of the header after its checksum followed by the values of the stack.
+ * 
+ * @param header The header.
+ * @param stack The values of the stack.
+ * @param size The size of the values in bytes.
+ * @return The checksum.
+ */
+static uint64_t checksum(const SnapshotHeader& header, const char* stack, size_t size) {
+    size_t start = offsetof(SnapshotHeader, fingerprint);
+    uint64_t hash = BytecodeFile::checksum((const char*) &header + start, sizeof(SnapshotHeader) - start);
+    return BytecodeFile::checksum(stack, size, hash);
+}
+
+// Constructor
+Snapshot::Snapshot(): header() {}
+
+/**
+ * Computes the fingerprint of a program, a snapshot can only be resumed by a program with the same fingerprint.
+ * It covers the optimized instructions and the literals of PSHW, so the same file loaded with another optimization level
+ * or value width does not match, since the instruction indexes and the stack layout would not match either.
+ * 
+ * @param code The instructions of the program.
+ * @param codeSize The number of instructions.
+ * @param constants The literal of every PSHW operand.
+ * @param valueBits The width of the values of the program.
+ * @return The fingerprint.
+ */
+uint64_t Snapshot::fingerprint(const Instruction* code, int codeSize, const int64_t* constants, int valueBits) {
+    uint64_t hash = BytecodeFile::checksum((const char*) &valueBits, sizeof(valueBits));
+    for (int i = 0; i < codeSize; i++) {
+        // The line index is left out, it is the same instruction whether the program was compiled or loaded from bytecode.
+        hash = BytecodeFile::checksum((const char*) &code[i].opcode, sizeof(code[i].opcode), hash);
+        hash = BytecodeFile::checksum((const char*) &code[i].operand, sizeof(code[i].operand), hash);
+        hash = BytecodeFile::checksum((const char*) &code[i].target, sizeof(code[i].target), hash);
+        if (code[i].opcode == Opcode::PSHW) hash = BytecodeFile::checksum((const char*) &constants[code[i].operand], sizeof(int64_t), hash);
+    }
+    return hash;
+}
+
+/**
+ * Writes a snapshot file, through a temporary file that replaces the old snapshot once it is complete.
+ * The checksum of the header is filled in here.
+ * 
+ * @param fileName The name of the file to write.
+ * @param header The header, everything but its checksum must be set.
+ * @param stack The values of the stack.
+ * @param size The size of the values in bytes.
+ * @return 0 if the file was written successfully, 1 otherwise.
+ */
+int Snapshot::write(string fileName, const SnapshotHeader& header, const char* stack, size_t size) {
+    SnapshotHeader complete = header;
+    complete.checksum = checksum(complete, stack, size);
+
+    string temporaryName = fileName + "." + to_string(getpid()) + ".tmp";
+    ofstream file(temporaryName, ios::binary);
+    if (!file.is_open()) return 1;
+    file.write((const char*) &complete, sizeof(complete));
+    file.write(stack, size);
+    file.close();
+    if (!file.good() || rename(temporaryName.c_str(), fileName.c_str()) != 0) {
+        remove(temporaryName.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Gets whether the process may fork a child to write a snapshot.
+ * After a fork only the calling thread exists in the child, so a lock another thread held, like the one of the allocator,
+ * stays locked forever and the child deadlocks as soon as it writes the file.
+ * The process may therefore only fork while it has a single thread, which is read from /proc/self/status.
+ * 
+ * @return True if the process has a single thread, false if it has more or the thread count can not be read.
+ */
+bool Snapshot::canFork() {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 8, "Threads:") == 0) return stoi(line.substr(8)) == 1;
+    }
+    return false;
+}
+
+/**
+ * Makes SIGUSR1 request a snapshot, see takeRequest().
+ */
+void Snapshot::handleSignal() {
+    struct sigaction action = {};
+    action.sa_handler = requestSnapshot;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, nullptr);
+}
+
+/**
+ * Gets whether a snapshot was requested since the last call, and forgets the request.
+ * 
+ * @return True if SIGUSR1 was received, false otherwise.
+ */
+bool Snapshot::takeRequest() {
+    if (snapshotRequested == 0) return false;
+    snapshotRequested = 0;
+    return true;
+}
+
+/**
+ * Loads a snapshot file.
+ * The file is rejected if it was written by another version of the format, or if its size or checksum do not match its header.
+ * Whether it fits the program that resumes it is checked by LemVM::resume().
+ * 
+ * @param fileName The name of the file to load.
+ * @param errorHandler The error handler to report errors with.
+ * @return 0 if the file was loaded successfully, 1 otherwise.
+ */
+int Snapshot::load(string fileName, ErrorHandler& errorHandler) {
+    ifstream file(fileName, ios::binary);
+    if (!file.is_open()) {
+        errorHandler.handleErrorNoLine("Could not open file: " + fileName);
+        return 1;
+    }
+
+    if (!file.read((char*) &header, sizeof(header)) || memcmp(header.magic, "LSS", 4) != 0) {
+        errorHandler.handleErrorNoLine("Invalid snapshot file: " + fileName);
+        return 1;
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        errorHandler.handleErrorNoLine("Stale snapshot file, it was written with version " + to_string(header.version)
+                                       + " but version " + to_string(SNAPSHOT_VERSION) + " is required: " + fileName);
+        return 1;
+    }
+
+    stack.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    if ((header.valueBits != 32 && header.valueBits != 64) || header.depth > stack.size() / (header.valueBits / 8)
+        || stack.size() != header.depth * (header.valueBits / 8) || header.steps < 0
+        || checksum(header, stack.data(), stack.size()) != header.checksum) {
+        errorHandler.handleErrorNoLine("Corrupt snapshot file: " + fileName);
+        return 1;
+    }
+    return 0; // The file was loaded successfully.
+}
+
+/**
+ * Gets the header of the loaded snapshot.
+ * 
+ * @return The header.
+ */
+const SnapshotHeader& Snapshot::getHeader() const {
+    return header;
+}
+
+/**
+ * Gets the values of the stack of the loaded snapshot, they are as wide as SnapshotHeader::valueBits.
+ * 
+ * @return The values, the bottom one first.
+ */
+const char* Snapshot::getStack() const {
+    return stack.data();
+}
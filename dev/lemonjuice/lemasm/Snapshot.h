@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "ErrorHandler.h"
+#include "Instruction.h"
+
+using namespace std;
+
+// The version of the snapshot format, snapshots with any other version are rejected.
+const uint32_t SNAPSHOT_VERSION = 1;
+
+/**
+ * The header at the start of every snapshot file.
+ * It is followed by the values of the stack, the bottom one first, each as wide as the values of the program.
+ * All values are stored in the byte order of the machine, like in bytecode files.
+ */
+struct SnapshotHeader {
+    char magic[4];           // Always "LSS" followed by a zero byte.
+    uint32_t version;        // The SNAPSHOT_VERSION the file was written with.
+    uint64_t checksum;       // The FNV-1a hash of the rest of the header and the stack.
+    uint64_t fingerprint;    // The fingerprint of the program the snapshot was taken of, see Snapshot::fingerprint().
+    uint32_t valueBits;      // The width of the values of the program, 32 or 64.
+    int32_t pc;              // The index of the instruction the run continues at.
+    int64_t steps;           // The number of instructions executed before the snapshot was taken.
+    uint64_t outputPosition; // The number of bytes the program had printed.
+    uint64_t random[4];      // The state of the random number generator, see Random.
+    uint64_t depth;          // The number of values on the stack.
+};
+
+/**
+ * A snapshot of a run that was stopped at a jump, which a later run can resume from, see LemVM::resume().
+ * It holds everything a run changes: the instruction it is at, the stack, the random number generator and how much was printed.
+ * 
+ * Snapshots are taken every n steps or when the process receives SIGUSR1, see VMOptions::snapshotFileName.
+ * The running process forks and the child writes the snapshot from its copy-on-write view of the stack, so the run only stops for the fork.
+ * A process with several threads must not fork, see canFork(), so there the run stops until the snapshot is written.
+ * Every snapshot is written to a temporary file first and renamed, so a crash while writing never leaves a broken snapshot behind.
+ */
+class Snapshot {
+private:
+    SnapshotHeader header;
+    string stack;
+
+public:
+    Snapshot();
+
+    static uint64_t fingerprint(const Instruction* code, int codeSize, const int64_t* constants, int valueBits);
+    static int write(string fileName, const SnapshotHeader& header, const char* stack, size_t size);
+    static bool canFork();
+    static void handleSignal();
+    static bool takeRequest();
+
+    int load(string fileName, ErrorHandler& errorHandler);
+    const SnapshotHeader& getHeader() const;
+    const char* getStack() const;
+};
@@ -0,0 +1,130 @@
+#include "SourceFile.h"
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Constructor
+SourceFile::SourceFile(): mapping(nullptr), size(0) {}
+
+// Destructor
+SourceFile::~SourceFile() {
+    close();
+}
+
+/**
+ * Maps a source file, an empty file is not mapped at all and reads as no lines.
+ * 
+ * @param fileName The name of the file to map.
+ * @return True if the file was mapped, false if it could not be opened or mapped.
+ */
+bool SourceFile::open(string fileName) {
+    close();
+    int descriptor = ::open(fileName.c_str(), O_RDONLY);
+    if (descriptor == -1) return false;
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        ::close(descriptor);
+        return false;
+    }
+
+    size = status.st_size;
+    if (size > 0) {
+        mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping == MAP_FAILED) mapping = nullptr;
+        else madvise(mapping, size, MADV_SEQUENTIAL);
+    }
+    ::close(descriptor);
+    return size == 0 || mapping != nullptr;
+}
+
+/**
+ * Drops the mapped pages before the given offset from memory, they stay mapped and are read from the file again if they are used.
+ * 
+ * @param offset The offset in the file, only the whole pages before it are dropped.
+ */
+void SourceFile::releaseBefore(size_t offset) const {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t end = offset - offset % pageSize;
+    if (mapping != nullptr && end > 0) madvise(mapping, end, MADV_DONTNEED);
+}
+
+/**
+ * Unmaps the file.
+ */
+void SourceFile::close() {
+    if (mapping != nullptr) munmap(mapping, size);
+    mapping = nullptr;
+    size = 0;
+}
+
+/**
+ * Gets the contents of the file.
+ * 
+ * @return The first byte of the file, or nullptr if the file is empty.
+ */
+const char* SourceFile::getData() const {
+    return (const char*) mapping;
+}
+
+/**
+ * Gets the size of the file.
+ * 
+ * @return The number of bytes of the file.
+ */
+size_t SourceFile::getSize() const {
+    return size;
+}
+
+// Constructor
+LineReader::LineReader(const SourceFile& file)
+    : file(file), data(file.getData()), size(file.getSize()), position(0), released(0), lineIndex(0) {}
+
+/**
+ * Reads the next line.
+ * A file that ends with a newline has no empty line after it, like with getline.
+ * 
+ * @param line Is set to the line, without its newline.
+ * @return True if a line was read, false at the end of the file.
+ */
+bool LineReader::next(string_view& line) {
+    if (position >= size) return false;
+    const char* start = data + position;
+    const char* end = (const char*) memchr(start, '\n', size - position);
+    size_t length = end == nullptr ? size - position : end - start;
+    line = string_view(start, length);
+    position += length + 1;
+    lineIndex++;
+
+    // The current line must stay mapped, so only the pages before it are released.
+    if (position - released >= RELEASE_INTERVAL) {
+        released = line.data() - data;
+        file.releaseBefore(released);
+    }
+    return true;
+}
+
+/**
+ * Gets the index of the next line, which is also the number of lines read so far.
+ * 
+ * @return The index of the next line.
+ */
+int LineReader::getLineIndex() const {
+    return lineIndex;
+}
+
+/**
+ * Gets where a line that was read by this reader starts in the file.
+ * 
+ * @param line The line.
+ * @return The offset of the line in the file.
+ */
+size_t LineReader::getOffset(string_view line) const {
+    return line.data() - data;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * A LemASM source file, memory mapped read-only so that it can be read line by line without being copied.
+ * Once a program has been compiled the file is closed, the lines that errors report are copied into the program first.
+ */
+class SourceFile {
+private:
+    void* mapping;
+    size_t size;
+
+public:
+    SourceFile();
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    bool open(string fileName);
+    void releaseBefore(size_t offset) const;
+    void close();
+    const char* getData() const;
+    size_t getSize() const;
+};
+
+/**
+ * Splits a source file into lines the same way getline does, every line is a slice of the file, without its newline.
+ * The pages that were read are released every few megabytes, so reading a huge file never keeps all of it in memory.
+ */
+class LineReader {
+private:
+    static const size_t RELEASE_INTERVAL = 1 << 24;
+
+    const SourceFile& file;
+    const char* data;
+    size_t size;
+    size_t position;
+    size_t released;
+    int lineIndex;
+
+public:
+    LineReader(const SourceFile& file);
+    bool next(string_view& line);
+    int getLineIndex() const;
+    size_t getOffset(string_view line) const;
+};
@@ -0,0 +1,275 @@
+#include "StackVerifier.h"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// How often the maximum depth of an instruction may grow before it is widened to UNBOUNDED.
+const int WIDEN_LIMIT = 3;
+
+// Constructor
+StackVerifier::StackVerifier(const vector<Instruction>& program, int stackSize, bool trapOverflow)
+    : StackVerifier(program.data(), program.size(), stackSize, trapOverflow) {}
+
+// Constructor, for instructions that are not in a vector, such as those of a mapped bytecode file.
+StackVerifier::StackVerifier(const Instruction* program, int programSize, int stackSize, bool trapOverflow)
+    : program(program), programSize(programSize), stackSize(stackSize), trapOverflow(trapOverflow), reached(programSize, false),
+      minimumDepth(programSize, 0), maximumDepth(programSize, 0), widenCount(programSize, 0), verified(false),
+      underflowSafe(false), peakDepth(0) {}
+
+/**
+ * Gets the error message for an opcode that does not have enough values on the stack.
+ * These are the same messages the execution loop reports at runtime.
+ * 
+ * @param opcode The opcode.
+ * @return The error message.
+ */
+string StackVerifier::underflowMessage(Opcode opcode) {
+    switch (opcode) {
+        case Opcode::ADD: case Opcode::ADDI: return "Stack does not have enough values to add.";
+        case Opcode::DIV: return "Stack does not have enough values to divide.";
+        case Opcode::MOD: return "Stack does not have enough values to take the modulus.";
+        case Opcode::MUL: case Opcode::MULI: return "Stack does not have enough values to multiply.";
+        case Opcode::SUB: case Opcode::SUBI: return "Stack does not have enough values to subtract.";
+        case Opcode::SWP: return "Stack does not have enough values to swap.";
+        case Opcode::SUM: return "Stack does not have enough values to sum.";
+        case Opcode::PRD: return "Stack does not have enough values to multiply.";
+        case Opcode::MIN: case Opcode::MAX: return "Stack does not have enough values to compare.";
+        case Opcode::REV: return "Stack does not have enough values to reverse.";
+        case Opcode::JEQ: case Opcode::JGT: case Opcode::JLT: case Opcode::JNE:
+        case Opcode::JEQI: case Opcode::JGTI: case Opcode::JLTI: case Opcode::JNEI:
+            return "Stack does not have enough values to jump.";
+        default: return "Stack is empty.";
+    }
+}
+
+/**
+ * Merges the stack depth range of an incoming control flow edge into the state of an instruction.
+ * If the state changed, the instruction is added to the worklist so its successors are updated as well.
+ * A maximum that keeps growing (a loop that pushes more than it pops) is widened to UNBOUNDED so the analysis terminates.
+ * 
+ * @param index The index of the instruction the edge leads to.
+ * @param minimum The minimum stack depth along the edge.
+ * @param maximum The maximum stack depth along the edge.
+ * @param worklist The instructions whose successors still have to be updated.
+ */
+void StackVerifier::mergeState(int index, int minimum, int maximum, vector<int>& worklist) {
+    if (!reached[index]) {
+        reached[index] = true;
+        minimumDepth[index] = minimum;
+        maximumDepth[index] = maximum;
+        worklist.push_back(index);
+        return;
+    }
+
+    bool changed = false;
+    if (minimum < minimumDepth[index]) {
+        minimumDepth[index] = minimum;
+        changed = true;
+    }
+    if (maximum > maximumDepth[index]) {
+        maximumDepth[index] = ++widenCount[index] > WIDEN_LIMIT ? UNBOUNDED : maximum;
+        changed = true;
+    }
+    if (changed) worklist.push_back(index);
+}
+
+/**
+ * Analyzes the stack usage of the program.
+ * This computes the minimum and maximum stack depth before every instruction, across every control flow edge.
+ * Conditional jumps are assumed to be able to go both ways.
+ * 
+ * Execution only continues past an instruction whose maximum depth is at least what it needs,
+ * so the successors of an instruction are only updated once some edge into it brings enough values.
+ * Once every edge has been merged, an instruction that can be reached but whose maximum depth is still lower than what it needs
+ * underflows on every run that reaches it. That alone does not make the program wrong, a run may never take the branch that leads there,
+ * so the first of them is only reported if every run gets to one of them, see alwaysUnderflows().
+ * 
+ * If every reachable instruction always has enough values, and can never push past the stack size,
+ * the program is verified and can be executed without any stack checks.
+ * 
+ * @return The index of an instruction that always underflows if every run gets to one, or -1 otherwise.
+ */
+int StackVerifier::analyze() {
+    vector<int> worklist;
+    mergeState(0, 0, 0, worklist);
+
+    while (!worklist.empty()) {
+        int index = worklist.back();
+        worklist.pop_back();
+        const Instruction& instruction = program[index];
+        int required = stackRequired(instruction);
+        int effect = stackEffect(instruction);
+
+        if (maximumDepth[index] < required) continue; // A later edge may still bring enough values, see below.
+
+        // Execution only continues past this instruction if the stack had enough values.
+        // The depths are capped at UNBOUNDED, so that the counts of FIL and SEQ can not overflow them.
+        int minimum = (int) min<int64_t>((int64_t) max(minimumDepth[index], required) + effect, UNBOUNDED);
+        int maximum = maximumDepth[index] == UNBOUNDED ? UNBOUNDED : (int) min<int64_t>((int64_t) maximumDepth[index] + effect, UNBOUNDED);
+
+        if (instruction.opcode == Opcode::RET || instruction.opcode == Opcode::END) continue;
+        if (instruction.opcode == Opcode::JMP || isConditionalJump(instruction.opcode)) {
+            mergeState(instruction.target, minimum, maximum, worklist);
+        }
+        if (instruction.opcode != Opcode::JMP) mergeState(index + 1, minimum, maximum, worklist);
+    }
+
+    if (alwaysUnderflows()) {
+        for (int i = 0; i < programSize; i++) {
+            if (reached[i] && maximumDepth[i] < stackRequired(program[i])) return i;
+        }
+    }
+
+    underflowSafe = true;
+    peakDepth = 0;
+    for (int i = 0; i < programSize; i++) {
+        if (!reached[i]) continue;
+        int effect = stackEffect(program[i]);
+        if (minimumDepth[i] < stackRequired(program[i])) underflowSafe = false;
+        peakDepth = (int) min<int64_t>(max<int64_t>(peakDepth, (int64_t) maximumDepth[i] + max(effect, 0)), UNBOUNDED);
+    }
+    verified = underflowSafe && peakDepth <= stackSize;
+
+    return -1; // Some run does not underflow.
+}
+
+/**
+ * Gets whether an instruction can stop a run with an error other than an underflow,
+ * a division by zero, an overflow of the stack or, with trapping, an arithmetic overflow.
+ * 
+ * @param index The index of the instruction, its state must have been computed by analyze().
+ * @return True if the instruction can fail on its own, false otherwise.
+ */
+bool StackVerifier::mayFail(int index) {
+    const Instruction& instruction = program[index];
+    int effect = stackEffect(instruction);
+    if (effect > 0 && (int64_t) maximumDepth[index] + effect > stackSize) return true;
+    switch (instruction.opcode) {
+        case Opcode::DIV: case Opcode::MOD: return true;
+        case Opcode::ADD: case Opcode::SUB: case Opcode::MUL: case Opcode::SUM: case Opcode::PRD: case Opcode::SEQ:
+        case Opcode::ADDI: case Opcode::SUBI: case Opcode::MULI:
+            return trapOverflow;
+        default: return false;
+    }
+}
+
+/**
+ * Gets whether every run of the program underflows, so that it can be rejected before it runs.
+ * That is the case if every path from the start of the program gets to an instruction that never has enough values,
+ * without passing a RET, an instruction that can fail in another way, or a loop, since a run may stay in a loop forever.
+ * 
+ * @return True if every run underflows, false otherwise.
+ */
+bool StackVerifier::alwaysUnderflows() {
+    vector<char> state(programSize, 0); // 0 if not visited yet, 1 while on the current path, 2 once every path from it underflows.
+    vector<pair<int, int>> path = {{0, 0}}; // Every instruction of the current path, with the number of its successors visited so far.
+    state[0] = 1;
+    while (!path.empty()) {
+        int index = path.back().first;
+        const Instruction& instruction = program[index];
+        if (maximumDepth[index] < stackRequired(instruction)) {
+            state[index] = 2;
+            path.pop_back();
+            continue;
+        }
+        if (instruction.opcode == Opcode::RET || instruction.opcode == Opcode::END || mayFail(index)) return false;
+
+        int successors[2];
+        int successorCount = 0;
+        if (instruction.opcode == Opcode::JMP || isConditionalJump(instruction.opcode)) successors[successorCount++] = instruction.target;
+        if (instruction.opcode != Opcode::JMP) successors[successorCount++] = index + 1;
+        if (path.back().second == successorCount) {
+            state[index] = 2;
+            path.pop_back();
+            continue;
+        }
+
+        int successor = successors[path.back().second++];
+        if (state[successor] == 1) return false;
+        if (state[successor] == 0) {
+            state[successor] = 1;
+            path.push_back({successor, 0});
+        }
+    }
+    return true;
+}
+
+/**
+ * Verifies the stack usage of the program, see analyze().
+ * A program that underflows on every run is rejected with the same error the execution loop would report.
+ * 
+ * @param source The program being compiled, its lines are used to report errors.
+ * @param errorHandler The error handler to report errors with.
+ * @return 0 if the program was not rejected, 1 otherwise.
+ */
+int StackVerifier::verify(const Program& source, ErrorHandler& errorHandler) {
+    int index = analyze();
+    if (index != -1) {
+        Line line = source.lineAt(program[index].lineIndex);
+        errorHandler.handleErrorWithLine(underflowMessage(program[index].opcode), line.getLineNumber(), line.getContents());
+        return 1;
+    }
+
+    return 0; // The program was not rejected.
+}
+
+/**
+ * Gets whether the program can be executed without any stack checks.
+ * 
+ * @return True if the program was verified, false otherwise.
+ */
+bool StackVerifier::isVerified() {
+    return verified;
+}
+
+/**
+ * Gets whether every reachable instruction always has enough values on the stack.
+ * 
+ * @return True if the program never underflows, false otherwise.
+ */
+bool StackVerifier::isUnderflowSafe() {
+    return underflowSafe;
+}
+
+/**
+ * Gets the deepest the stack can get while running the program.
+ * 
+ * @return The peak stack depth, or UNBOUNDED if it can grow without limit.
+ */
+int StackVerifier::getPeakDepth() {
+    return peakDepth;
+}
+
+/**
+ * Gets whether an instruction can be reached from the start of the program.
+ * 
+ * @param index The index of the instruction.
+ * @return True if the instruction can be reached, false otherwise.
+ */
+bool StackVerifier::isReached(int index) {
+    return reached[index];
+}
+
+/**
+ * Gets the minimum stack depth before an instruction.
+ * 
+ * @param index The index of the instruction.
+ * @return The minimum stack depth.
+ */
+int StackVerifier::getMinimumDepth(int index) {
+    return minimumDepth[index];
+}
+
+/**
+ * Gets the maximum stack depth before an instruction.
+ * 
+ * @param index The index of the instruction.
+ * @return The maximum stack depth, or UNBOUNDED if it can grow without limit.
+ */
+int StackVerifier::getMaximumDepth(int index) {
+    return maximumDepth[index];
+}
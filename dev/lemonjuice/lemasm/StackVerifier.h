@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "ErrorHandler.h"
+#include "Instruction.h"
+#include "Line.h"
+#include "Program.h"
+
+using namespace std;
+
+class StackVerifier {
+private:
+    const Instruction* program;
+    int programSize;
+    int stackSize;
+    bool trapOverflow;
+    vector<bool> reached;
+    vector<int> minimumDepth;
+    vector<int> maximumDepth;
+    vector<int> widenCount;
+    bool verified;
+    bool underflowSafe;
+    int peakDepth;
+
+    void mergeState(int index, int minimum, int maximum, vector<int>& worklist);
+    bool mayFail(int index);
+    bool alwaysUnderflows();
+
+public:
+    static const int UNBOUNDED = 1 << 30;
+
+    StackVerifier(const vector<Instruction>& program, int stackSize, bool trapOverflow = false);
+    StackVerifier(const Instruction* program, int programSize, int stackSize, bool trapOverflow = false);
+    int analyze();
+    int verify(const Program& source, ErrorHandler& errorHandler);
+    bool isVerified();
+    bool isUnderflowSafe();
+    int getPeakDepth();
+    bool isReached(int index);
+    int getMinimumDepth(int index);
+    int getMaximumDepth(int index);
+
+    static string underflowMessage(Opcode opcode);
+};
@@ -0,0 +1,145 @@
+#include "Statistics.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+using namespace std;
+
+// Constructor
+Statistics::Statistics()
+    : opcodeCounts(OPCODE_COUNT, 0), branchesTaken(0), peakDepth(0), bytesPrinted(0), parseMilliseconds(0), executionMilliseconds(0),
+      peakMemoryKilobytes(0), result(0), failed(false) {}
+
+/**
+ * Clears the counters of the execution, at the start of a run.
+ * The parse time is kept, it is set before the run starts.
+ */
+void Statistics::start() {
+    opcodeCounts.assign(OPCODE_COUNT, 0);
+    branchesTaken = 0;
+    peakDepth = 0;
+}
+
+/**
+ * Records how the run went once it has returned, and reads the peak memory of the process.
+ * 
+ * @param executionMilliseconds How long the run took.
+ * @param bytesPrinted How many bytes the program printed.
+ * @param result What the run returned.
+ * @param failed Whether the run stopped with a runtime error.
+ */
+void Statistics::finish(double executionMilliseconds, uint64_t bytesPrinted, int result, bool failed) {
+    this->executionMilliseconds = executionMilliseconds;
+    this->bytesPrinted = bytesPrinted;
+    this->result = result;
+    this->failed = failed;
+    struct rusage usage;
+    peakMemoryKilobytes = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+/**
+ * Sets how long it took to load the program, which is measured by whoever loaded it.
+ * 
+ * @param milliseconds The parse time.
+ */
+void Statistics::setParseTime(double milliseconds) {
+    parseMilliseconds = milliseconds;
+}
+
+/**
+ * Gets how many instructions the run executed.
+ * 
+ * @return The number of executed instructions.
+ */
+uint64_t Statistics::getInstructionCount() const {
+    uint64_t count = 0;
+    for (uint64_t opcodeCount : opcodeCounts) count += opcodeCount;
+    return count;
+}
+
+/**
+ * Gets how many conditional jumps the run executed, taken or not.
+ * 
+ * @return The number of executed conditional jumps.
+ */
+uint64_t Statistics::getBranchCount() const {
+    uint64_t count = 0;
+    for (int i = 0; i < OPCODE_COUNT; i++) {
+        if (isConditionalJump((Opcode) i)) count += opcodeCounts[i];
+    }
+    return count;
+}
+
+/**
+ * Prints the statistics as a table, followed by the count of every opcode that was executed.
+ * 
+ * @param out The stream to print to.
+ */
+void Statistics::report(ostream& out) const {
+    uint64_t branches = getBranchCount();
+    char buffer[96];
+    out << endl << "Statistics:" << endl;
+    snprintf(buffer, sizeof(buffer), "%-24s %llu", "Instructions executed", (unsigned long long) getInstructionCount());
+    out << buffer << endl;
+    snprintf(buffer, sizeof(buffer), "%-24s %llu taken, %llu not taken", "Branches", (unsigned long long) branchesTaken,
+             (unsigned long long) (branches - branchesTaken));
+    out << buffer << endl;
+    snprintf(buffer, sizeof(buffer), "%-24s %lld", "Peak stack depth", (long long) peakDepth);
+    out << buffer << endl;
+    snprintf(buffer, sizeof(buffer), "%-24s %llu", "Bytes printed", (unsigned long long) bytesPrinted);
+    out << buffer << endl;
+    snprintf(buffer, sizeof(buffer), "%-24s %.3f ms", "Parse time", parseMilliseconds);
+    out << buffer << endl;
+    snprintf(buffer, sizeof(buffer), "%-24s %.3f ms", "Execution time", executionMilliseconds);
+    out << buffer << endl;
+    snprintf(buffer, sizeof(buffer), "%-24s %ld KB", "Peak memory", peakMemoryKilobytes);
+    out << buffer << endl;
+
+    out << endl << "Opcode Histogram:" << endl;
+    for (int i = 0; i < OPCODE_COUNT; i++) {
+        if (opcodeCounts[i] == 0) continue;
+        snprintf(buffer, sizeof(buffer), "%14llu  %s", (unsigned long long) opcodeCounts[i], opcodeName((Opcode) i));
+        out << buffer << endl;
+    }
+}
+
+/**
+ * Writes the statistics as a single JSON object, for scripts that collect them.
+ * Every opcode that was executed is a key of the "opcodes" object, the times are in milliseconds and the memory in kilobytes.
+ * 
+ * @param fileName The name of the file to write.
+ * @return True if the file was written, false otherwise.
+ */
+bool Statistics::writeJson(string fileName) const {
+    ofstream file(fileName);
+    if (!file.is_open()) return false;
+
+    uint64_t branches = getBranchCount();
+    char buffer[64];
+    file << "{\n";
+    file << "  \"result\": " << result << ",\n";
+    file << "  \"failed\": " << (failed ? "true" : "false") << ",\n";
+    file << "  \"instructions\": " << getInstructionCount() << ",\n";
+    file << "  \"opcodes\": {";
+    bool first = true;
+    for (int i = 0; i < OPCODE_COUNT; i++) {
+        if (opcodeCounts[i] == 0) continue;
+        file << (first ? "" : ",") << "\n    \"" << opcodeName((Opcode) i) << "\": " << opcodeCounts[i];
+        first = false;
+    }
+    file << (first ? "},\n" : "\n  },\n");
+    file << "  \"branchesTaken\": " << branchesTaken << ",\n";
+    file << "  \"branchesNotTaken\": " << branches - branchesTaken << ",\n";
+    file << "  \"peakStackDepth\": " << peakDepth << ",\n";
+    file << "  \"bytesPrinted\": " << bytesPrinted << ",\n";
+    snprintf(buffer, sizeof(buffer), "%.3f", parseMilliseconds);
+    file << "  \"parseMilliseconds\": " << buffer << ",\n";
+    snprintf(buffer, sizeof(buffer), "%.3f", executionMilliseconds);
+    file << "  \"executionMilliseconds\": " << buffer << ",\n";
+    file << "  \"peakMemoryKilobytes\": " << peakMemoryKilobytes << "\n";
+    file << "}\n";
+    return file.good();
+}
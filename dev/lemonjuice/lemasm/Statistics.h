@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Instruction.h"
+
+using namespace std;
+
+/**
+ * Collects the runtime statistics of a run, for the --stats and --stats-json flags.
+ * The counters are only updated by the instrumented execution loop, so a run without statistics does not pay for them.
+ * The opcodes that are counted are those of the optimized program, like in the profile and the trace.
+ */
+class Statistics {
+private:
+    vector<uint64_t> opcodeCounts;
+    uint64_t branchesTaken;
+    int64_t peakDepth;
+    uint64_t bytesPrinted;
+    double parseMilliseconds;
+    double executionMilliseconds;
+    long peakMemoryKilobytes;
+    int result;
+    bool failed;
+
+public:
+    Statistics();
+    void start();
+    void finish(double executionMilliseconds, uint64_t bytesPrinted, int result, bool failed);
+    void setParseTime(double milliseconds);
+    uint64_t getInstructionCount() const;
+    uint64_t getBranchCount() const;
+    void report(ostream& out) const;
+    bool writeJson(string fileName) const;
+
+    /**
+     * Records that an instruction starts executing.
+     * 
+     * @param opcode The opcode of the instruction.
+     * @param depth The depth of the stack before the instruction.
+     */
+    void enter(Opcode opcode, int64_t depth) {
+        opcodeCounts[(int) opcode]++;
+        if (depth > peakDepth) peakDepth = depth;
+    }
+
+    // Records that a conditional jump was taken.
+    void takeBranch() {
+        branchesTaken++;
+    }
+};
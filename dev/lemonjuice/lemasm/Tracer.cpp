@@ -0,0 +1,75 @@
+#include "Tracer.h"
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Constructor
+Tracer::Tracer(): head(0), recorded(0), sampleRate(1), sampleCounter(0) {}
+
+/**
+ * Clears the ring buffer and decides which instructions are recorded.
+ * 
+ * @param code The instructions of the program.
+ * @param size The number of instructions.
+ * @param lineNumbers The source line number of every instruction.
+ * @param jumpMap The labels of the program.
+ * @param filter Which instructions to record.
+ * @param capacity How many records the ring buffer holds.
+ * @param sampleRate Only every sampleRate-th instruction that passes the filter is recorded.
+ * @return True if the tracer was started, false if the label of the filter does not exist.
+ */
+bool Tracer::start(const Instruction* code, int size, const vector<int>& lineNumbers, const map<string, int>& jumpMap,
+                   const TraceFilter& filter, int capacity, int sampleRate) {
+    // The block of a label runs from the label up to the next label.
+    int blockStart = 0;
+    int blockEnd = size;
+    if (!filter.label.empty()) {
+        auto entry = jumpMap.find(filter.label);
+        if (entry == jumpMap.end()) return false;
+        blockStart = entry->second;
+        for (auto const& x : jumpMap) {
+            if (x.second > blockStart) blockEnd = min(blockEnd, x.second);
+        }
+    }
+
+    selected.assign(size, 0);
+    for (int i = blockStart; i < blockEnd; i++) {
+        selected[i] = lineNumbers[i] >= filter.firstLine && lineNumbers[i] <= filter.lastLine
+                   && (filter.opcodes.empty() || filter.opcodes.count(code[i].opcode) > 0);
+    }
+
+    this->lineNumbers = lineNumbers;
+    this->sampleRate = sampleRate;
+    ring.assign(capacity, {0, 0, 0, 0});
+    head = 0;
+    recorded = 0;
+    sampleCounter = sampleRate - 1; // The first instruction that passes the filter is always recorded.
+    return true;
+}
+
+/**
+ * Prints the most recent records, oldest first, one per line.
+ * 
+ * @param out The stream to print to.
+ * @param count The maximum number of records to print.
+ */
+void Tracer::dump(ostream& out, size_t count) {
+    size_t available = min<uint64_t>(recorded, ring.size());
+    count = min(count, available);
+
+    out << "Trace: the last " << count << " of " << recorded << " recorded instructions." << endl;
+    size_t index = (head + ring.size() - count) % ring.size();
+    for (size_t i = 0; i < count; i++) {
+        const TraceRecord& record = ring[index];
+        out << "pc=" << record.pc << " line=" << lineNumbers[record.pc] << " op=" << opcodeName((Opcode) record.opcode)
+            << " depth=" << record.depth;
+        if (record.depth > 0) out << " top=" << record.top;
+        out << "\n";
+        if (++index == ring.size()) index = 0;
+    }
+    out.flush();
+}
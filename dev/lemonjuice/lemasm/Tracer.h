@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+#include "Instruction.h"
+
+using namespace std;
+
+// One executed instruction, as recorded by the Tracer.
+struct TraceRecord {
+    int32_t pc;     // The index of the instruction.
+    int32_t opcode; // The opcode of the instruction.
+    int32_t depth;  // The depth of the stack before the instruction.
+    int64_t top;    // The top value of the stack before the instruction, or 0 if the stack was empty.
+};
+
+// Which instructions the Tracer records, an empty filter records every instruction.
+struct TraceFilter {
+    int firstLine = 0;         // The first source line to record.
+    int lastLine = INT32_MAX;  // The last source line to record.
+    set<Opcode> opcodes;       // The opcodes to record, or empty to record every opcode.
+    string label;              // The label whose block is recorded, or empty to record every block.
+};
+
+/**
+ * Records executed instructions into a fixed size ring buffer, for the --trace flag.
+ * Recording an instruction only copies a few integers, so a program can keep tracing on and only look at the trace when it fails.
+ */
+class Tracer {
+private:
+    vector<TraceRecord> ring;
+    size_t head;
+    uint64_t recorded;
+    vector<char> selected;
+    vector<int> lineNumbers;
+    int sampleRate;
+    int sampleCounter;
+
+public:
+    Tracer();
+    bool start(const Instruction* code, int size, const vector<int>& lineNumbers, const map<string, int>& jumpMap,
+               const TraceFilter& filter, int capacity, int sampleRate);
+    void dump(ostream& out, size_t count);
+
+    /**
+     * Records that the instruction at the given index starts executing, if it passes the filter and the sampling.
+     * 
+     * @param pc The index of the instruction.
+     * @param opcode The opcode of the instruction.
+     * @param top The top value of the stack.
+     * @param depth The depth of the stack.
+     */
+    void record(int pc, Opcode opcode, int64_t top, int depth) {
+        if (!selected[pc] || ++sampleCounter < sampleRate) return;
+        sampleCounter = 0;
+        ring[head] = {pc, (int32_t) opcode, depth, top};
+        if (++head == ring.size()) head = 0;
+        recorded++;
+    }
+};
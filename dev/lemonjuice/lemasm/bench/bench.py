@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""
+The LemASM benchmark harness.
+
+Runs every benchmark program in this directory, plus a few that are generated on the fly, many times and prints
+the results as JSON, so that the numbers of two interpreter versions can be compared by a script.
+
+Every benchmark declares how many LemASM instructions it executes in a "// Instructions: N" comment.
+The count is taken from the program as written (as if it ran with -O0), so instructions per second stay comparable
+between optimization levels and interpreter versions, even when the optimizer fuses or removes instructions.
+
+Usage: python3 bench.py [--interpreter <path>] [--runs <n>] [--output <file>] [-- <LemASM flags>]
+Example: python3 bench.py --interpreter ../LemASM --runs 10 -- --jit
+"""
+
+import argparse
+import json
+import os
+import platform
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH_DIRECTORY = os.path.dirname(os.path.abspath(__file__))
+STARTUP_RUNS = 20 # How many times the empty program is run to measure the startup time.
+
+
+def generateDataSection(directory, strings=50000, printed=1000):
+    """
+    Generates a program with a large data section, of which only a small part is printed.
+    This mostly measures how fast the data section is read.
+    """
+    step = strings // printed
+    path = os.path.join(directory, "data_section.lemasm")
+    with open(path, "w") as file:
+        file.write("// Benchmark: a data section of %d strings, every %dth string is printed.\n" % (strings, step))
+        file.write("// Instructions: %d\n\n#DATA\n" % (printed + 1))
+        for i in range(strings):
+            file.write("STR string_%d = \"String number %d of the generated data section\n" % (i, i))
+        file.write("\n#CODE\n")
+        for i in range(0, strings, step):
+            file.write("CPR string_%d\n" % i)
+        file.write("RET\n")
+    return path
+
+
+def generateLongProgram(directory, blocks=40000):
+    """
+    Generates a very long straight line program, split into blocks that each jump to the next label.
+    This mostly measures how fast the code section is compiled and optimized.
+    """
+    path = os.path.join(directory, "long_program.lemasm")
+    with open(path, "w") as file:
+        file.write("// Benchmark: %d generated blocks of straight line code that jump from one to the next.\n" % blocks)
+        file.write("// Instructions: %d\n\n#CODE\n" % (blocks * 5 + 1))
+        for i in range(blocks):
+            file.write(".block_%d\nPSH %d\nPSH %d\nADD\nPOP\nJMP block_%d\n" % (i, i, i + 1, i + 1))
+        file.write(".block_%d\nRET\n" % blocks)
+    return path
+
+
+def generateEmptyProgram(directory):
+    """
+    Generates the smallest possible program, it is used to measure the startup time of the interpreter.
+    """
+    path = os.path.join(directory, "empty.lemasm")
+    with open(path, "w") as file:
+        file.write("#CODE\nRET\n")
+    return path
+
+
+def instructionCount(path):
+    """
+    Reads the "// Instructions: N" comment of a benchmark.
+    """
+    with open(path) as file:
+        for line in file:
+            match = re.match(r"//\s*Instructions:\s*(\d+)", line)
+            if match:
+                return int(match.group(1))
+    raise ValueError("Benchmark has no instruction count: " + path)
+
+
+def runOnce(command):
+    """
+    Runs the interpreter once with its output discarded.
+    Returns the wall time in seconds, the peak resident set size in KiB and the exit code.
+    """
+    start = time.perf_counter()
+    process = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    _, status, usage = os.wait4(process.pid, 0)
+    wall = time.perf_counter() - start
+    process.returncode = os.waitstatus_to_exitcode(status)
+    return wall, usage.ru_maxrss, process.returncode
+
+
+def runBenchmark(interpreter, path, flags, runs):
+    """
+    Runs a benchmark once to warm up, then the given number of times, and summarizes the runs.
+    """
+    command = [interpreter, path] + flags
+    runOnce(command)
+
+    walls = []
+    peakRss = 0
+    exitCodes = set()
+    for _ in range(runs):
+        wall, rss, exitCode = runOnce(command)
+        walls.append(wall)
+        peakRss = max(peakRss, rss)
+        exitCodes.add(exitCode)
+
+    instructions = instructionCount(path)
+    median = statistics.median(walls)
+    return {
+        "name": os.path.splitext(os.path.basename(path))[0],
+        "instructions": instructions,
+        "runs": runs,
+        "wall_seconds": {
+            "min": min(walls),
+            "median": median,
+            "mean": statistics.mean(walls),
+            "max": max(walls),
+        },
+        "instructions_per_second": instructions / median if median > 0 else None,
+        "peak_rss_kib": peakRss,
+        "exit_codes": sorted(exitCodes),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Runs the LemASM benchmarks and prints the results as JSON.")
+    parser.add_argument("--interpreter", default=os.path.join(BENCH_DIRECTORY, "..", "LemASM"), help="The LemASM executable to benchmark.")
+    parser.add_argument("--runs", type=int, default=5, help="How many times every benchmark is run, after one warm up run.")
+    parser.add_argument("--output", help="Write the JSON to this file instead of the console.")
+    parser.add_argument("flags", nargs=argparse.REMAINDER, help="Flags passed to the interpreter, after a \"--\".")
+    arguments = parser.parse_args()
+
+    interpreter = os.path.abspath(arguments.interpreter)
+    flags = [flag for flag in arguments.flags if flag != "--"]
+    if arguments.runs < 1:
+        parser.error("--runs must be at least 1")
+    if not os.access(interpreter, os.X_OK):
+        parser.error("The interpreter is not an executable: " + interpreter)
+
+    with tempfile.TemporaryDirectory(prefix="lemasm-bench-") as directory:
+        benchmarks = sorted(os.path.join(BENCH_DIRECTORY, name) for name in os.listdir(BENCH_DIRECTORY) if name.endswith(".lemasm"))
+        benchmarks += [generateDataSection(directory), generateLongProgram(directory)]
+
+        startup = [runOnce([interpreter, generateEmptyProgram(directory)] + flags)[0] for _ in range(STARTUP_RUNS)]
+
+        results = []
+        for path in benchmarks:
+            print("Running " + os.path.basename(path), file=sys.stderr)
+            results.append(runBenchmark(interpreter, path, flags, arguments.runs))
+
+    report = {
+        "interpreter": interpreter,
+        "flags": flags,
+        "machine": platform.machine(),
+        "system": platform.system(),
+        "startup_seconds": statistics.median(startup),
+        "benchmarks": results,
+    }
+
+    text = json.dumps(report, indent=2)
+    if arguments.output:
+        with open(arguments.output, "w") as file:
+            file.write(text + "\n")
+    else:
+        print(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <cctype>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "../Context.h"
+#include "../LemVM.h"
+#include "../Program.h"
+#include "../Random.h"
+#include "ProgramGenerator.h"
+#include "ReferenceInterpreter.h"
+
+using namespace std;
+
+// An execution mode of the LemVM that is compared with the reference interpreter.
+struct Mode {
+    string name;      // How the mode is reported, as the LemASM flags that select it.
+    VMOptions options; // The options of the mode, the value width, overflow trapping and seed are set per run.
+    bool bytecode;    // Is the program written to a bytecode file and loaded from it before it runs.
+};
+
+// Globals
+uint64_t seed = random_device()(); // The seed of the programs that are generated, default is a random seed.
+int64_t programCount = 0; // How many programs are generated, or 0 to keep going until a mismatch is found, default is 0.
+string corpus = ""; // The directory of programs that are checked before the generated ones, default is none.
+int64_t stepBudget = 10000; // How many instructions the reference interpreter runs a program for before giving up on it, default is 10000.
+const uint64_t RUN_SEED = 42; // The seed of the random number generator of every run, so that RAN and ROR draw the same numbers everywhere.
+const size_t PROGRAM_BYTES = 256; // How many bytes every program is generated from.
+const unsigned int HANG_SECONDS = 10; // How long the checks of a single program may take before the fuzzer reports that a run hangs.
+char hangMessage[512] = ""; // What the fuzzer prints when a run hangs, it is prepared before every program since the alarm handler can not format it.
+
+/**
+ * Gets every execution mode of the LemVM, from the one closest to the reference interpreter to the most optimized ones.
+ * 
+ * @return The modes.
+ */
+vector<Mode> executionModes() {
+    vector<Mode> modes;
+    for (int level = 0; level <= 2; level++) {
+        Mode mode = {"--dispatch switch -O" + to_string(level), VMOptions(), false};
+        mode.options.threadedDispatch = false;
+        mode.options.optimizationLevel = level;
+        modes.push_back(mode);
+    }
+#ifdef LEMASM_THREADED_DISPATCH
+    for (int level = 0; level <= 2; level++) {
+        Mode mode = {"--dispatch threaded -O" + to_string(level), VMOptions(), false};
+        mode.options.optimizationLevel = level;
+        modes.push_back(mode);
+    }
+#endif
+    Mode jit = {"--jit", VMOptions(), false};
+    jit.options.jitMode = true;
+    modes.push_back(jit);
+    Mode stats = {"--stats", VMOptions(), false};
+    stats.options.statsMode = true;
+    modes.push_back(stats);
+    Mode limited = {"--max-steps", VMOptions(), false};
+    limited.options.maxSteps = INT64_MAX / 2;
+    modes.push_back(limited);
+    modes.push_back({"--compile", VMOptions(), true});
+    return modes;
+}
+
+/**
+ * Formats the values of a stack for a mismatch report.
+ * 
+ * @param stack The values, the bottom one first.
+ * @return The values separated by spaces.
+ */
+string formatStack(const vector<int64_t>& stack) {
+    string text = "[";
+    for (size_t i = 0; i < stack.size(); i++) text += (i == 0 ? "" : " ") + to_string(stack[i]);
+    return text + "]";
+}
+
+/**
+ * Runs a program in one execution mode and compares how the run ended with how the reference interpreter run ended.
+ * The output, the result and whether the run failed must match, and so must the final stack of a run that did not fail.
+ * 
+ * @param fileName The source file of the program.
+ * @param mode The execution mode.
+ * @param expected How the reference interpreter run ended.
+ * @param report Is set to what did not match.
+ * @return True if the run matched, false otherwise.
+ */
+bool compareRun(string fileName, Mode mode, const ReferenceOutcome& expected, string& report) {
+    LemVM vm(mode.options);
+    Program program;
+    Program bytecode;
+    if (vm.load(fileName, program) != 0) {
+        report = "The program was rejected while loading.";
+        return false;
+    }
+    string bytecodeFileName = fileName + ".lbc";
+    if (mode.bytecode && (vm.writeBytecode(program, bytecodeFileName) != 0 || vm.loadBytecode(bytecodeFileName, bytecode) != 0)) {
+        report = "The program could not be written to bytecode and loaded again.";
+        return false;
+    }
+
+    Context context;
+    context.getOutput().capture();
+    int result = vm.run(mode.bytecode ? bytecode : program, context);
+    const string& output = context.getOutput().getCaptured();
+    vector<int64_t> stack = context.getStack();
+
+    if (context.hasFailed() != expected.failed) {
+        report = "The run " + string(context.hasFailed() ? "failed" : "did not fail") + ", but the reference run " + (expected.failed ? "failed." : "did not.");
+    } else if (result != expected.result) {
+        report = "The run returned " + to_string(result) + ", but the reference run returned " + to_string(expected.result) + ".";
+    } else if (output != expected.output) {
+        report = "The run printed:\n" + output + "but the reference run printed:\n" + expected.output;
+    } else if (!expected.failed && stack != expected.stack) {
+        report = "The run left " + formatStack(stack) + " on the stack, but the reference run left " + formatStack(expected.stack) + ".";
+    } else {
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Loads a program into the LemVM, keeping the line that its errors are reported at.
+ * 
+ * @param fileName The file of the program.
+ * @param options The options of the LemVM.
+ * @param program The program to load into.
+ * @param errorLine Is set to the line the LemVM reports an error at, or 0 if it loads or no line is reported.
+ * @return 0 if the program was loaded, 1 otherwise.
+ */
+int load(string fileName, const VMOptions& options, Program& program, int& errorLine) {
+    ostringstream errors;
+    ios::iostate errorState = cerr.rdstate(); // Setting the buffer clears the state, so it is kept first.
+    streambuf* errorBuffer = cerr.rdbuf(errors.rdbuf());
+    int result = LemVM(options).load(fileName, program);
+    cerr.rdbuf(errorBuffer);
+    cerr.setstate(errorState);
+
+    string text = errors.str();
+    size_t position = text.find("At line: ");
+    errorLine = position == string::npos ? 0 : atoi(text.c_str() + position + 9);
+    return result;
+}
+
+/**
+ * Checks every execution mode against the reference interpreter on a program, with and without overflow trapping.
+ * Runs that the reference interpreter does not finish within the step budget are skipped.
+ * The LemVM refuses to load a program that underflows on every run, so refusing a program that the reference interpreter finishes without an underflow,
+ * or one where it ran the refused line, is a mismatch.
+ * 
+ * @param source The program.
+ * @param valueBits The width of the values, 32 or 64.
+ * @param fileName The file the program is written to, so that the LemVM can load it.
+ * @param mustLoad Is a program that the LemVM refuses to load a mismatch even if its run underflows.
+ * @param report Is set to the program and what did not match.
+ * @return The number of runs that matched in every mode, or -1 if a mode did not match.
+ */
+int checkSource(const string& source, int valueBits, string fileName, bool mustLoad, string& report) {
+    static const vector<Mode> modes = executionModes();
+    vector<ReferenceOutcome> expected;
+    for (bool trapOverflow : {false, true}) {
+        expected.push_back(ReferenceInterpreter(valueBits, trapOverflow, Context::DEFAULT_STACK_SIZE, RUN_SEED).run(source, stepBudget));
+    }
+
+    ofstream file(fileName, ios::binary);
+    file << source;
+    file.close();
+
+    VMOptions options;
+    options.valueBits = valueBits;
+    Program program;
+    int rejectedLine = 0;
+    if (load(fileName, options, program, rejectedLine) != 0) {
+        // The run without trapping goes the furthest. The StackVerifier only rejects programs that underflow on every run,
+        // so neither a run that it finishes without an underflow nor one that got past the rejected line may be rejected.
+        const ReferenceOutcome& run = expected[0];
+        bool ranRejectedLine = run.safeLines.count(rejectedLine) > 0;
+        if (!mustLoad && !ranRejectedLine && (!run.finished || run.underflowed)) return 0;
+        report = source + "\nThe LemVM does not load it" + (valueBits == 64 ? " with --int64" : "")
+               + (rejectedLine > 0 ? " because of line " + to_string(rejectedLine) : "") + ", but the reference interpreter "
+               + (ranRejectedLine ? "runs that line" : run.finished && !run.underflowed ? "runs it without an underflow" : "does not reject it") + ".\n";
+        return -1;
+    }
+
+    int checked = 0;
+    for (bool trapOverflow : {false, true}) {
+        if (!expected[trapOverflow].finished) continue;
+        checked++;
+
+        for (Mode mode : modes) {
+            mode.options.valueBits = valueBits;
+            mode.options.trapOverflow = trapOverflow;
+            mode.options.seeded = true;
+            mode.options.seed = RUN_SEED;
+            string mismatch;
+            if (!compareRun(fileName, mode, expected[trapOverflow], mismatch)) {
+                string flags = mode.name + (valueBits == 64 ? " --int64" : "") + (trapOverflow ? " --trap-overflow" : "");
+                report = source + "\nMismatch with " + flags + " --seed " + to_string(RUN_SEED) + ":\n" + mismatch + "\n";
+                return -1;
+            }
+        }
+    }
+    return checked;
+}
+
+/**
+ * Generates a program from some bytes and checks it with 32-bit and 64-bit values, see checkSource().
+ * 
+ * @param data The bytes to generate the program from.
+ * @param size The number of bytes.
+ * @param fileName The file the program is written to, so that the LemVM can load it.
+ * @param report Is set to the program and what did not match.
+ * @return 1 if every mode matched, 0 if the program was skipped, -1 if a mode did not match.
+ */
+int checkProgram(const uint8_t* data, size_t size, string fileName, string& report) {
+    int checked = 0;
+    for (int valueBits : {32, 64}) {
+        int result = checkSource(ProgramGenerator(data, size).generate(valueBits == 64), valueBits, fileName, false, report);
+        if (result < 0) return -1;
+        checked += result;
+    }
+    return checked > 0 ? 1 : 0;
+}
+
+/**
+ * Checks the programs in a directory, which must all load and match in every mode, see checkSource().
+ * They are programs that once ended differently, kept so that the difference can not come back.
+ * 
+ * @param directory The directory, every .lemasm file in it is checked.
+ * @param fileName The file the programs are written to, so that the LemVM can load them.
+ * @return The number of programs that were checked, or -1 if one of them did not match, after its report is printed.
+ */
+int64_t checkCorpus(string directory, string fileName) {
+    vector<filesystem::path> paths;
+    for (const filesystem::directory_entry& entry : filesystem::directory_iterator(directory)) {
+        if (entry.path().extension() == ".lemasm") paths.push_back(entry.path());
+    }
+    sort(paths.begin(), paths.end());
+
+    for (const filesystem::path& path : paths) {
+        ifstream file(path, ios::binary);
+        string source((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        for (int valueBits : {32, 64}) {
+            string report;
+            snprintf(hangMessage, sizeof(hangMessage), "%s hangs in one of the execution modes.\n", path.string().c_str());
+            alarm(HANG_SECONDS);
+            int checked = checkSource(source, valueBits, fileName, true, report);
+            alarm(0);
+            if (checked < 0) {
+                cout << path.string() << ":" << endl << report;
+                return -1;
+            }
+        }
+    }
+    return paths.size();
+}
+
+/**
+ * Reports that a run hangs and stops the fuzzer, this is the SIGALRM handler so it only writes the prepared message.
+ * A run that the reference interpreter finished within the step budget can only hang if an execution mode loops where it should not.
+ * 
+ * @param signal The signal that was received.
+ */
+void reportHang(int signal) {
+    (void) signal;
+    ssize_t written = write(STDOUT_FILENO, hangMessage, strlen(hangMessage));
+    (void) written;
+    _exit(1);
+}
+
+#ifdef LEMASM_LIBFUZZER
+/**
+ * The entry point for libFuzzer, every input is turned into a program and checked, see checkProgram().
+ * A mismatch aborts, so that libFuzzer keeps the input that caused it.
+ * 
+ * @param data The input.
+ * @param size The size of the input.
+ * @return Always 0.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static const string fileName = (filesystem::temp_directory_path() / ("lemfuzz." + to_string(getpid()) + ".lemasm")).string();
+    cerr.setstate(ios::failbit); // The runtime errors of the programs are expected, they would drown out the report.
+    string report;
+    if (checkProgram(data, size, fileName, report) < 0) {
+        cout << report << flush;
+        abort();
+    }
+    return 0;
+}
+#else
+/**
+ * Main function of LemFuzz, the differential fuzzer of LemASM.
+ * 
+ * It generates random programs with the ProgramGenerator, runs every one of them in the ReferenceInterpreter,
+ * then in every execution mode of the LemVM, and stops at the first run that ends differently, see checkProgram().
+ * The programs only depend on the seed, so a mismatch can be reproduced by running again with the same seed.
+ * The program of a mismatch is written to lemfuzz-<seed>-<index>.lemasm, it can be run with the flags in the report.
+ * A program whose checks take longer than HANG_SECONDS is reported as a hang, it is left in the temporary file the fuzzer runs programs from.
+ * 
+ * Acceptable arguments are:
+ *    - Seed                                  > --seed <n>
+ *    - Number Of Programs                    > --programs <n> (0 to run until a mismatch is found)
+ *    - Step Budget                           > --steps <n>
+ *    - Corpus                                > --corpus <directory> (programs that are checked before the generated ones)
+ * 
+ * @param argc The number of command-line arguments.
+ * @param argv The command-line arguments.
+ * @return 0 if every program matched, 1 otherwise.
+ */
+int main(int argc, char* argv[]) {
+    string usageString = "Usage: LemFuzz [--seed <n>] [--programs <n>] [--steps <n>] [--corpus <directory>]";
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        string value = i + 1 < argc ? argv[++i] : "";
+        bool valid = !value.empty() && value.size() <= 18 && all_of(value.begin(), value.end(), [](unsigned char c){return isdigit(c);});
+        if (arg == "--corpus" && filesystem::is_directory(value)) corpus = value;
+        else if (valid && arg == "--seed") seed = stoull(value);
+        else if (valid && arg == "--programs") programCount = stoll(value);
+        else if (valid && arg == "--steps" && stoll(value) > 0) stepBudget = stoll(value);
+        else {
+            cerr << "Invalid argument: " << arg << " " << value << endl << usageString << endl;
+            return 1;
+        }
+    }
+
+    string fileName = (filesystem::temp_directory_path() / ("lemfuzz." + to_string(getpid()) + ".lemasm")).string();
+    cout << "Fuzzing with seed " << seed << "." << endl;
+    cerr.setstate(ios::failbit); // The runtime errors of the programs are expected, they would drown out the report.
+
+    signal(SIGALRM, reportHang);
+    if (!corpus.empty()) {
+        int64_t corpusCount = checkCorpus(corpus, fileName);
+        if (corpusCount < 0) {
+            remove(fileName.c_str());
+            remove((fileName + ".lbc").c_str());
+            return 1;
+        }
+        cout << corpusCount << " programs of " << corpus << " matched in every mode." << endl;
+    }
+
+    Random random(seed);
+    int64_t checkedCount = 0;
+    int64_t skippedCount = 0;
+    int status = 0;
+    for (int64_t index = 0; programCount == 0 || index < programCount; index++) {
+        uint8_t data[PROGRAM_BYTES];
+        for (size_t i = 0; i < PROGRAM_BYTES; i++) data[i] = (uint8_t) random.next();
+
+        string report;
+        snprintf(hangMessage, sizeof(hangMessage), "Program %lld hangs in one of the execution modes, it was left in %s.\n", (long long) index, fileName.c_str());
+        alarm(HANG_SECONDS);
+        int checked = checkProgram(data, PROGRAM_BYTES, fileName, report);
+        alarm(0);
+        if (checked < 0) {
+            string programName = "lemfuzz-" + to_string(seed) + "-" + to_string(index) + ".lemasm";
+            ofstream program(programName, ios::binary);
+            program << report.substr(0, min(report.find("\nMismatch with "), report.find("\nThe LemVM does not load it")));
+            cout << "Program " << index << " (" << programName << "):" << endl << report;
+            status = 1;
+            break;
+        }
+        if (checked > 0) checkedCount++;
+        else skippedCount++;
+        if ((index + 1) % 1000 == 0) cout << index + 1 << " programs, " << skippedCount << " skipped." << endl;
+    }
+
+    remove(fileName.c_str());
+    remove((fileName + ".lbc").c_str());
+    cout << checkedCount << " programs matched in every mode, " << skippedCount << " were skipped." << endl;
+    return status;
+}
+#endif
@@ -0,0 +1,124 @@
+#include "ProgramGenerator.h"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The mnemonics the generator picks from, the common ones appear more than once so that they are picked more often.
+static const char* const mnemonics[] = {
+    "PSH", "PSH", "PSH", "PSH", "PSH", "ADD", "ADD", "SUB", "SUB", "MUL", "MUL", "DIV", "MOD", "DUP", "DUP", "SWP", "POP",
+    "CPK", "CPP", "CPP", "CPR", "FLS", "RAN", "ROR", "JEQ", "JGT", "JLT", "JNE", "JMP",
+    "SUM", "PRD", "MIN", "MAX", "FIL", "SEQ", "REV"
+};
+static const int MNEMONIC_COUNT = sizeof(mnemonics) / sizeof(mnemonics[0]);
+
+// Constructor
+ProgramGenerator::ProgramGenerator(const uint8_t* data, size_t size): data(data), size(size), position(0) {}
+
+/**
+ * Makes the next choice.
+ * 
+ * @param bound The number of options, at most 256.
+ * @return A number from 0 to bound - 1, 0 once the bytes run out.
+ */
+int ProgramGenerator::choose(int bound) {
+    if (position >= size) return 0;
+    return data[position++] % bound;
+}
+
+/**
+ * Picks a literal for PSH, mostly small numbers, but also the edges of the value width so that arithmetic wraps around.
+ * 
+ * @param wide Whether the program runs with 64-bit values, only then can literals be outside of the 32-bit range.
+ * @return The literal.
+ */
+long long ProgramGenerator::literal(bool wide) {
+    switch (choose(wide ? 12 : 10)) {
+        case 0: return INT_MAX;
+        case 1: return INT_MIN;
+        case 2: return 65536 + choose(256);
+        case 3: return -choose(256) * 1000;
+        case 10: return LLONG_MAX - choose(4);
+        case 11: return LLONG_MIN + choose(4);
+        default: return choose(19) - 9;
+    }
+}
+
+/**
+ * Generates a program.
+ * 
+ * @param wide Whether the program runs with 64-bit values.
+ * @return The source of the program.
+ */
+string ProgramGenerator::generate(bool wide) {
+    int stringCount = 1 + choose(3);
+    string source = "#DATA\n";
+    for (int i = 0; i < stringCount; i++) source += "STR s" + to_string(i) + " = \"text " + to_string(i) + "\n";
+    source += "#CODE\n";
+
+    int lineCount = 4 + choose(48);
+    int labelCount = choose(5);
+    vector<int> labelLines; // The line every label is placed before.
+    for (int i = 0; i < labelCount; i++) labelLines.push_back(choose(lineCount + 1));
+
+    // The depth of the stack is tracked along the lines, and at every label it is the lowest depth of the jumps seen so far that go there.
+    // Instructions that need more values get pushes in front of them, otherwise most programs would be rejected by the StackVerifier.
+    int depth = choose(5);
+    vector<int> labelDepths(labelCount, INT_MAX);
+    for (int i = 0; i < depth; i++) source += "PSH " + to_string(literal(wide)) + "\n";
+
+    for (int line = 0; line <= lineCount; line++) {
+        for (int label = 0; label < labelCount; label++) {
+            if (labelLines[label] != line) continue;
+            source += ".l" + to_string(label) + "\n";
+            depth = min(depth, labelDepths[label]);
+        }
+        if (line == lineCount) break;
+
+        string mnemonic = mnemonics[choose(MNEMONIC_COUNT)];
+        if (mnemonic[0] == 'J' && labelCount == 0) mnemonic = "DUP";
+        bool jump = mnemonic[0] == 'J';
+        bool bulk = mnemonic == "SUM" || mnemonic == "PRD" || mnemonic == "MIN" || mnemonic == "MAX" || mnemonic == "FIL"
+                 || mnemonic == "SEQ" || mnemonic == "REV";
+        // Mostly short runs, sometimes long enough for the SIMD kernels to take over.
+        int count = !bulk ? 0 : choose(8) == 0 ? 1 + choose(64) : 1 + choose(6);
+
+        int needed = 0; // How many values the instruction needs.
+        int effect = 0; // How the instruction changes the depth.
+        if (mnemonic == "PSH" || mnemonic == "RAN") effect = 1;
+        else if (mnemonic == "DUP") needed = 1, effect = 1;
+        else if (mnemonic == "POP" || mnemonic == "CPP") needed = 1, effect = -1;
+        else if (mnemonic == "CPK") needed = 1;
+        else if (mnemonic == "SWP") needed = 2;
+        else if (mnemonic == "JMP") needed = 0;
+        else if (jump) needed = 2, effect = -2;
+        else if (mnemonic == "FIL" || mnemonic == "SEQ") needed = 1, effect = count - 1;
+        else if (mnemonic == "REV") needed = count;
+        else if (bulk) needed = count, effect = 1 - count;
+        else if (mnemonic != "CPR" && mnemonic != "FLS" && mnemonic != "ROR") needed = 2, effect = -1;
+
+        // Now and then the pushes are left out, so that runtime underflows are checked as well.
+        if (choose(16) != 0) {
+            for (; depth < needed; depth++) source += "PSH " + to_string(literal(wide)) + "\n";
+        }
+        depth = max(0, depth + effect);
+
+        if (jump) {
+            // Prefer a label after this line, backward jumps make loops that the step budget of the fuzzer has to stop.
+            int label = choose(labelCount);
+            for (int i = 0; i < labelCount && labelLines[label] <= line && choose(4) != 0; i++) label = (label + 1) % labelCount;
+            labelDepths[label] = min(labelDepths[label], depth);
+            source += mnemonic + " l" + to_string(label) + "\n";
+        }
+        else if (mnemonic == "PSH") source += "PSH " + to_string(literal(wide)) + "\n";
+        else if (mnemonic == "CPR") source += "CPR s" + to_string(choose(stringCount)) + "\n";
+        else if (bulk) source += mnemonic + " " + to_string(count) + "\n";
+        else source += mnemonic + "\n";
+    }
+    if (choose(5) != 0) source += "RET\n";
+    return source;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/**
+ * Turns a string of bytes into a valid LemASM program, for the fuzzer, see LemFuzz.cpp.
+ * 
+ * Every choice the generator makes reads the next byte, and once the bytes run out every choice is 0,
+ * so any input is a program and inputs that are close to each other are programs that are close to each other, which is what libFuzzer needs.
+ * The programs only use labels and strings that exist, but they may underflow, overflow, divide by zero or loop forever,
+ * which the fuzzer has to handle, see ReferenceInterpreter.
+ * Jumps favour the forward direction, so most programs end on their own.
+ */
+class ProgramGenerator {
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+
+    int choose(int bound);
+    long long literal(bool wide);
+
+public:
+    ProgramGenerator(const uint8_t* data, size_t size);
+    string generate(bool wide);
+};
@@ -0,0 +1,258 @@
+#include "ReferenceInterpreter.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Constructor
+ReferenceInterpreter::ReferenceInterpreter(int valueBits, bool trapOverflow, int stackSize, uint64_t seed)
+    : valueBits(valueBits), trapOverflow(trapOverflow), stackSize(stackSize), codeSectionLine(0), random(seed) {}
+
+/**
+ * Gets whether an exact number fits in the value width.
+ * 
+ * @param value The number.
+ * @return True if the number fits, false otherwise.
+ */
+bool ReferenceInterpreter::fits(__int128 value) {
+    if (valueBits == 32) return value >= INT32_MIN && value <= INT32_MAX;
+    return value >= INT64_MIN && value <= INT64_MAX;
+}
+
+/**
+ * Cuts an exact number down to the value width, the way two's complement hardware wraps around.
+ * 
+ * @param value The number.
+ * @return The number modulo 2 to the power of the value width.
+ */
+int64_t ReferenceInterpreter::wrap(__int128 value) {
+    uint64_t bits = (uint64_t) value;
+    if (valueBits == 32) return (int32_t) (uint32_t) bits;
+    return (int64_t) bits;
+}
+
+/**
+ * Reads the strings of the data section into the stringMap, like the original dataSection() did.
+ * 
+ * @return 0 if the data section was read successfully, 1 otherwise.
+ */
+int ReferenceInterpreter::dataSection() {
+    for (int i = 0; i < codeSectionLine - 1; i++) {
+        string contents = lines[i].getContents();
+        if (contents == "#DATA" || contents.empty() || contents.find("//") == 0) continue;
+        if (contents.find("STR") != 0) return 1;
+        string str = contents.substr(4);
+        string key = str.substr(0, str.find(" "));
+        string value = str.substr(str.find("\"") + 1);
+        stringMap[key] = value;
+    }
+    return 0;
+}
+
+/**
+ * Runs a program from its source.
+ * 
+ * @param source The source of the program.
+ * @param stepBudget The most instructions the run may execute, a run that goes over it is not finished.
+ * @return How the run ended.
+ */
+ReferenceOutcome ReferenceInterpreter::run(const string& source, int64_t stepBudget) {
+    ReferenceOutcome outcome;
+    istringstream file(source);
+    string text;
+    while (getline(file, text)) {
+        lines.push_back(Line(lines.size() + 1, text));
+        if (text == "#CODE") codeSectionLine = lines.size();
+    }
+
+    // Every label is known before the program starts, so forward jumps work.
+    for (int i = codeSectionLine; i < (int) lines.size(); i++) {
+        string contents = lines[i].getContents();
+        if (contents.find(".") == 0) jumpMap[contents.substr(1)] = i;
+    }
+
+    // Ends the run with a runtime error, everything printed so far is kept.
+    auto fail = [&]() {
+        outcome.finished = true;
+        outcome.failed = true;
+        outcome.result = 1;
+        return outcome;
+    };
+    // Ends the run with a runtime error because the stack does not have enough values.
+    auto underflow = [&]() {
+        outcome.underflowed = true;
+        return fail();
+    };
+    // Ends the run successfully with the given result.
+    auto finish = [&](int result) {
+        outcome.finished = true;
+        outcome.result = result;
+        outcome.stack = lStack;
+        return outcome;
+    };
+    // Pops the top value of the stack.
+    auto pop = [&]() {
+        int64_t value = lStack.back();
+        lStack.pop_back();
+        return value;
+    };
+
+    if (codeSectionLine == 0 || dataSection() != 0) return fail();
+
+    int64_t steps = 0;
+    for (int i = codeSectionLine; i < (int) lines.size(); i++) {
+        string contents = lines[i].getContents();
+        if (contents.find("//") == 0 || contents.find(".") == 0) continue;
+        else if (contents.empty() || all_of(contents.begin(), contents.end(), [](unsigned char c){return isspace(c);})) continue;
+        if (++steps > stepBudget) return outcome;
+        int lineNumber = lines[i].getLineNumber(); // Jumps change i, the line is only marked as safe once it ran.
+
+        string mnemonic = contents.substr(0, 3);
+        string operand = contents.size() > 4 ? contents.substr(4) : "";
+        int64_t count = mnemonic == "SUM" || mnemonic == "PRD" || mnemonic == "MIN" || mnemonic == "MAX" || mnemonic == "FIL"
+                     || mnemonic == "SEQ" || mnemonic == "REV" ? stoll(operand) : 0;
+
+        // Add (ADD), Subtract (SUB) and Multiply (MUL), always b op a.
+        if (mnemonic == "ADD" || mnemonic == "SUB" || mnemonic == "MUL") {
+            if (lStack.size() < 2) return underflow();
+            __int128 a = pop();
+            __int128 b = pop();
+            __int128 exact = mnemonic == "ADD" ? b + a : mnemonic == "SUB" ? b - a : b * a;
+            if (trapOverflow && !fits(exact)) return fail();
+            lStack.push_back(wrap(exact));
+        }
+
+        // Divide (DIV) and Modulus (MOD), always b op a, the remainder has the sign of b.
+        else if (mnemonic == "DIV" || mnemonic == "MOD") {
+            if (lStack.size() < 2) return underflow();
+            __int128 a = pop();
+            __int128 b = pop();
+            if (a == 0) return fail();
+            __int128 exact = mnemonic == "DIV" ? b / a : b % a;
+            if (trapOverflow && !fits(exact)) return fail();
+            lStack.push_back(wrap(exact));
+        }
+
+        // Console Peek (CPK) and Console Pop (CPP)
+        else if (mnemonic == "CPK" || mnemonic == "CPP") {
+            if (lStack.empty()) return underflow();
+            outcome.output += to_string(lStack.back()) + "\n";
+            if (mnemonic == "CPP") lStack.pop_back();
+        }
+
+        // Console Print (CPR)
+        else if (mnemonic == "CPR") {
+            if (stringMap.find(operand) == stringMap.end()) return fail();
+            outcome.output += stringMap[operand] + "\n";
+        }
+
+        // Duplicate (DUP)
+        else if (mnemonic == "DUP") {
+            if (lStack.empty()) return underflow();
+            if ((int64_t) lStack.size() == stackSize) return fail();
+            lStack.push_back(lStack.back());
+        }
+
+        // Flush (FLS), the output is only compared once the run is over.
+        else if (mnemonic == "FLS") {}
+
+        // Jump Equal (JEQ), Jump Greater Than (JGT), Jump Less Than (JLT) and Jump Not Equal (JNE), always b compared with a.
+        else if (mnemonic == "JEQ" || mnemonic == "JGT" || mnemonic == "JLT" || mnemonic == "JNE") {
+            if (lStack.size() < 2) return underflow();
+            int64_t a = pop();
+            int64_t b = pop();
+            bool taken = mnemonic == "JEQ" ? b == a : mnemonic == "JGT" ? b > a : mnemonic == "JLT" ? b < a : b != a;
+            if (taken) i = jumpMap.at(operand);
+        }
+
+        // Jump (JMP)
+        else if (mnemonic == "JMP") {
+            i = jumpMap.at(operand);
+        }
+
+        // Push (PSH)
+        else if (mnemonic == "PSH") {
+            if ((int64_t) lStack.size() == stackSize) return fail();
+            lStack.push_back(stoll(operand));
+        }
+
+        // Pop (POP)
+        else if (mnemonic == "POP") {
+            if (lStack.empty()) return underflow();
+            lStack.pop_back();
+        }
+
+        // Random (RAN)
+        else if (mnemonic == "RAN") {
+            if ((int64_t) lStack.size() == stackSize) return fail();
+            lStack.push_back(random.nextInt());
+        }
+
+        // Return (RET), it returns the low 32 bits of the top value and leaves it on the stack.
+        else if (mnemonic == "RET") {
+            return finish(lStack.empty() ? 0 : (int) lStack.back());
+        }
+
+        // Randomize Order (ROR)
+        else if (mnemonic == "ROR") {
+            random.shuffle(lStack.data(), lStack.data() + lStack.size());
+        }
+
+        // Swap (SWP)
+        else if (mnemonic == "SWP") {
+            if (lStack.size() < 2) return underflow();
+            swap(lStack[lStack.size() - 1], lStack[lStack.size() - 2]);
+        }
+
+        // Sum (SUM) and Product (PRD), the same as count - 1 ADDs or MULs.
+        else if (mnemonic == "SUM" || mnemonic == "PRD") {
+            if ((int64_t) lStack.size() < count) return underflow();
+            for (int64_t j = 1; j < count; j++) {
+                __int128 a = pop();
+                __int128 b = pop();
+                __int128 exact = mnemonic == "SUM" ? b + a : b * a;
+                if (trapOverflow && !fits(exact)) return fail();
+                lStack.push_back(wrap(exact));
+            }
+        }
+
+        // Minimum (MIN) and Maximum (MAX) of the top count values.
+        else if (mnemonic == "MIN" || mnemonic == "MAX") {
+            if ((int64_t) lStack.size() < count) return underflow();
+            int64_t extreme = pop();
+            for (int64_t j = 1; j < count; j++) {
+                int64_t value = pop();
+                extreme = mnemonic == "MIN" ? min(extreme, value) : max(extreme, value);
+            }
+            lStack.push_back(extreme);
+        }
+
+        // Fill (FIL) and Sequence (SEQ), the top value becomes the first of count values.
+        else if (mnemonic == "FIL" || mnemonic == "SEQ") {
+            if (lStack.empty()) return underflow();
+            if ((int64_t) lStack.size() + count - 1 > stackSize) return fail();
+            __int128 start = pop();
+            if (mnemonic == "SEQ" && trapOverflow && !fits(start + count - 1)) return fail();
+            for (int64_t j = 0; j < count; j++) lStack.push_back(mnemonic == "FIL" ? (int64_t) start : wrap(start + j));
+        }
+
+        // Reverse (REV) the top count values.
+        else if (mnemonic == "REV") {
+            if ((int64_t) lStack.size() < count) return underflow();
+            reverse(lStack.end() - count, lStack.end());
+        }
+
+        // After all the mnemonics are checked, the line is invalid.
+        else {
+            return fail();
+        }
+        outcome.safeLines.insert(lineNumber);
+    }
+
+    return finish(0); // The end of the program was reached.
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "../Line.h"
+#include "../Random.h"
+
+using namespace std;
+
+// What a run of the reference interpreter ended with, it is compared with what every execution mode of the LemVM ends with.
+struct ReferenceOutcome {
+    bool finished = false;  // False if the run went over its step budget, in which case nothing else is known.
+    bool failed = false;    // Did the run stop with a runtime error.
+    bool underflowed = false; // Was the error that the stack did not have enough values for an instruction.
+    int result = 0;         // What the run returned, 1 if it failed.
+    string output;          // Everything the run printed.
+    vector<int64_t> stack;  // The values left on the stack, the bottom one first, only if the run did not fail.
+    set<int> safeLines;     // The numbers of the lines that ran at least once without an error.
+};
+
+/**
+ * The reference interpreter that the fuzzer compares the LemVM with, see LemFuzz.cpp.
+ * 
+ * It interprets the code section line by line, the way the original codeSection() did:
+ * every step looks at the text of the line again, nothing is compiled, optimized or verified, and the stack is a plain vector.
+ * Values are kept as exact numbers and cut down to the value width after every operation, so wrapping and trapping are easy to check.
+ * Only the forward jumps that the original interpreter got wrong are fixed, every label is found before the program starts.
+ * 
+ * It only needs to understand the programs of the ProgramGenerator, which puts every mnemonic and its operand in the same place.
+ * An interpreter runs a single program, the fuzzer creates a new one for every run.
+ */
+class ReferenceInterpreter {
+private:
+    int valueBits;
+    bool trapOverflow;
+    int stackSize;
+    vector<Line> lines;
+    int codeSectionLine;
+    map<string, int> jumpMap;
+    map<string, string> stringMap;
+    vector<int64_t> lStack;
+    Random random;
+
+    bool fits(__int128 value);
+    int64_t wrap(__int128 value);
+    int dataSection();
+
+public:
+    ReferenceInterpreter(int valueBits, bool trapOverflow, int stackSize, uint64_t seed);
+    ReferenceOutcome run(const string& source, int64_t stepBudget);
+};